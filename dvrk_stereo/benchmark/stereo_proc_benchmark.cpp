@@ -0,0 +1,182 @@
+#include "stereo_proc.hpp"
+
+#include <benchmark/benchmark.h>
+#include <opencv2/imgproc.hpp>
+#include <sensor_msgs/image_encodings.h>
+
+#include <boost/make_shared.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+
+// Crop and resize cost of StereoImageProcessor, without ROS transport.
+// Run with --benchmark_filter=<regex> to pick cases; items/s is frames/s,
+// bytes/s counts the input image.
+
+namespace {
+
+// operator new calls of the current thread; ROS background threads are not counted, and neither is
+// cv::fastMalloc, which calls malloc directly (see test/allocation_test.cpp for a full count)
+thread_local size_t allocations = 0;
+
+}
+
+void* operator new(size_t size) {
+    ++allocations;
+    void* pointer = std::malloc(size == 0 ? 1 : size);
+    if (!pointer) {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void operator delete(void* pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    std::free(pointer);
+}
+
+namespace {
+
+struct Size {
+    const char* name;
+    int width;
+    int height;
+};
+
+// Inputs: 720p, de-interlaced 1080i, 4K UHD
+const Size input_sizes[] = {{"720p", 1280, 720}, {"1080", 1920, 1080}, {"4K", 3840, 2160}};
+// Outputs: the console's 1280x1024, a wide 1280x640, a quarter of the console,
+// and exact 3:1 and 2:1 reductions of 4K and 1080 for the box filter path
+const Size output_sizes[] = {{"1280x1024", 1280, 1024}, {"1280x640", 1280, 640}, {"640x512", 640, 512},
+                             {"1280x720", 1280, 720}, {"960x540", 960, 540}};
+const char* const encodings[] = {"rgb8", "bgr8", "bgra8", "mono8", "yuv422"};
+const struct {
+    const char* name;
+    int method;
+} interpolations[] = {{"nearest", cv::INTER_NEAREST}, {"linear", cv::INTER_LINEAR},
+                      {"area", cv::INTER_AREA}, {"cubic", cv::INTER_CUBIC}};
+
+sensor_msgs::ImagePtr makeImage(int width, int height, const std::string& encoding) {
+    namespace enc = sensor_msgs::image_encodings;
+    sensor_msgs::ImagePtr image = boost::make_shared<sensor_msgs::Image>();
+    image->header.frame_id = "benchmark";
+    image->width = width;
+    image->height = height;
+    image->encoding = encoding;
+    image->step = width * enc::numChannels(encoding) * enc::bitDepth(encoding) / 8;
+    image->data.resize(static_cast<size_t>(image->step) * height);
+    // Gradient, so area and cubic filters see real data rather than a constant
+    for (size_t i = 0; i < image->data.size(); ++i) {
+        image->data[i] = static_cast<uint8_t>((i * 7) ^ (i >> 9));
+    }
+    return image;
+}
+
+sensor_msgs::CameraInfoPtr makeInfo(int width, int height) {
+    sensor_msgs::CameraInfoPtr info = boost::make_shared<sensor_msgs::CameraInfo>();
+    info->header.frame_id = "benchmark";
+    info->width = width;
+    info->height = height;
+    info->K[0] = info->P[0] = width / 2.0;
+    info->K[4] = info->P[5] = width / 2.0;
+    info->K[2] = info->P[2] = width / 2.0;
+    info->K[5] = info->P[6] = height / 2.0;
+    info->K[8] = info->P[10] = 1.0;
+    return info;
+}
+
+void imageBenchmark(benchmark::State& state, const Size& in, const Size& out, const char* encoding, int method) {
+    dvrk_stereo::StereoImageProcessor processor(method);
+    processor.setDesiredSize(out.width, out.height);
+    sensor_msgs::ImagePtr image = makeImage(in.width, in.height, encoding);
+    // The first frame fills the output pool and per thread buffers
+    processor.resizeImage(image);
+
+    size_t first_allocation = allocations;
+    for (auto _ : state) {
+        image->header.seq++;
+        sensor_msgs::ImageConstPtr resized = processor.resizeImage(image);
+        benchmark::DoNotOptimize(resized);
+    }
+    // 0 once the output pool is reused; OpenCV's own buffers are not seen by this counter
+    state.counters["allocations"] = benchmark::Counter(static_cast<double>(allocations - first_allocation),
+                                                       benchmark::Counter::kAvgIterations);
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image->data.size()));
+}
+
+// The engine alone on an rgb8 frame, with the remap table in place of cv::resize
+void remapBenchmark(benchmark::State& state, const Size& in, const Size& out, int method) {
+    dvrk_stereo::ResizeEngine engine(method);
+    engine.setUseRemap(true);
+    cv::Mat image(in.height, in.width, CV_8UC3);
+    cv::randu(image, cv::Scalar::all(0), cv::Scalar::all(255));
+    // Centre crop to the output aspect ratio, as StereoImageProcessor does
+    int width = std::min(in.width, in.height * out.width / out.height);
+    int height = std::min(in.height, in.width * out.height / out.width);
+    cv::Rect roi((in.width - width) / 2, (in.height - height) / 2, width, height);
+    cv::Mat resized;
+
+    for (auto _ : state) {
+        engine.resize(image, roi, cv::Size(out.width, out.height), resized);
+        benchmark::DoNotOptimize(resized.data);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.total() * image.elemSize()));
+}
+
+void infoBenchmark(benchmark::State& state, const Size& in, const Size& out) {
+    dvrk_stereo::StereoImageProcessor processor;
+    processor.setDesiredSize(out.width, out.height);
+    sensor_msgs::CameraInfoPtr info = makeInfo(in.width, in.height);
+
+    for (auto _ : state) {
+        info->header.seq++;
+        sensor_msgs::CameraInfoConstPtr resized = processor.resizeInfo(info);
+        benchmark::DoNotOptimize(resized);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+void registerBenchmarks() {
+    for (const Size& in : input_sizes) {
+        for (const Size& out : output_sizes) {
+            std::string size = std::string(in.name) + "/" + out.name;
+            benchmark::RegisterBenchmark(("infoCallback/" + size).c_str(), infoBenchmark, in, out);
+            for (const char* encoding : encodings) {
+                for (const auto& interpolation : interpolations) {
+                    std::string name = "imageCallback/" + size + "/" + encoding + "/" + interpolation.name;
+                    benchmark::RegisterBenchmark(name.c_str(), imageBenchmark, in, out, encoding, interpolation.method)
+                        ->Unit(benchmark::kMillisecond)
+                        ->UseRealTime();
+                }
+            }
+            for (const auto& interpolation : interpolations) {
+                if (interpolation.method == cv::INTER_AREA) {
+                    continue;
+                }
+                std::string name = "remap/" + size + "/rgb8/" + interpolation.name;
+                benchmark::RegisterBenchmark(name.c_str(), remapBenchmark, in, out, interpolation.method)
+                    ->Unit(benchmark::kMillisecond)
+                    ->UseRealTime();
+            }
+        }
+    }
+}
+
+}
+
+int main(int argc, char** argv) {
+    // StereoImageProcessor owns node handles; nothing is advertised, so no master is needed
+    ros::init(argc, argv, "stereo_proc_benchmark", ros::init_options::AnonymousName | ros::init_options::NoRosout);
+
+    benchmark::Initialize(&argc, argv);
+    registerBenchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+
+    return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef DVRK_STEREO_IMAGE_POOL
+#define DVRK_STEREO_IMAGE_POOL
+
+#include <cstddef>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <opencv2/core.hpp>
+#include <sensor_msgs/Image.h>
+
+namespace dvrk_stereo {
+
+// Output messages recycled once nothing else references them, so images are
+// scaled straight into a message buffer that is already allocated. A message
+// is in use while a caller or an intra-process subscriber holds a pointer to it;
+// remote subscribers serialize it during publish.
+class ImagePool {
+public:
+    explicit ImagePool(size_t capacity);
+
+    // Message with header, size and encoding set and data sized for it; type is the
+    // cv::Mat type of the encoding. Allocated only if every pooled message is in use.
+    sensor_msgs::ImagePtr acquire(const std_msgs::Header& header, int width, int height,
+                                  const std::string& encoding, int type);
+
+    // cv::Mat header over the data of image, without copying
+    static cv::Mat view(sensor_msgs::Image& image, int type);
+
+private:
+    std::mutex mutex;
+    size_t capacity;
+    std::vector<sensor_msgs::ImagePtr> images;
+};
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef DVRK_STEREO_RESIZE_ENGINE
+#define DVRK_STEREO_RESIZE_ENGINE
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <opencv2/core.hpp>
+
+namespace dvrk_stereo {
+
+// Scales a region of an image to the output size with the selected interpolation.
+// Area interpolation at an exact 2:1 or 3:1 ratio is a plain box filter and takes a
+// dedicated path; with remap enabled, the other methods sample through a table
+// built once per input size, region and output size. resize() may be called from
+// several threads at once.
+class ResizeEngine {
+public:
+    explicit ResizeEngine(int cv_interpolation_method);
+
+    void setInterpolation(int cv_interpolation_method);
+    void setUseRemap(bool use_remap);
+    // Row bands the box path is split into; cv::resize and cv::remap follow cv::setNumThreads
+    void setThreads(int threads);
+    int interpolation() const { return cv_interpolation_method; }
+
+    void resize(const cv::Mat& image, const cv::Rect& roi, const cv::Size& size, cv::Mat& resized);
+    // Packed 4:2:2 (UYVY or YUYV, CV_8UC2): luma is scaled at full resolution and chroma pairs
+    // at half width, then both are interleaved again. luma_channel is 1 for UYVY, 0 for YUYV;
+    // roi.x, roi.width and size.width must be even.
+    void resizePackedYuv(const cv::Mat& image, const cv::Rect& roi, const cv::Size& size,
+                         int luma_channel, cv::Mat& resized);
+
+    // cv::INTER_* value of "nearest", "linear", "area" or "cubic", -1 for anything else
+    static int parseInterpolation(const std::string& name);
+    static std::string interpolationName(int cv_interpolation_method);
+
+private:
+    // Fixed-point tables for cv::remap and the geometry they were built for
+    struct RemapTable {
+        cv::Mat xy, fraction;
+        cv::Size image_size;
+        cv::Rect roi;
+        cv::Size size;
+    };
+
+    // Finds or builds the table for this geometry; call with map_mutex held
+    const RemapTable& remapTable(const cv::Size& image_size, const cv::Rect& roi, const cv::Size& size);
+
+    int cv_interpolation_method;
+    bool use_remap;
+    int threads;
+
+    // Two tables, for packed YUV luma and chroma; a new table replaces the older one in new
+    // buffers, so a resize still using it is not affected
+    std::mutex map_mutex;
+    RemapTable remap_tables[2];
+    int next_remap_table;
+};
+
+// Averages factor x factor blocks of 8-bit pixels with round-half-up; factor is 2 or 3.
+// width and height are the output size, src must hold factor times as many rows and columns.
+void boxDownscale(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step,
+                  int width, int height, int channels, int factor);
+
+}
+
+#endif
@@ -1,11 +1,20 @@
 #ifndef DVRK_STEREO_PROC
 #define DVRK_STEREO_PROC
 
+#include <memory>
 #include <mutex>
 #include <string>
 
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 #include <image_transport/image_transport.h>
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/core.hpp>
+#include <sensor_msgs/CameraInfo.h>
+#include <rvinci_profiler/profiler.h>
+
+#include "image_pool.hpp"
+#include "resize_engine.hpp"
 
 namespace dvrk_stereo {
 
@@ -13,32 +22,131 @@ class StereoImageProcessor {
 public:
     StereoImageProcessor();
     StereoImageProcessor(int cv_interpolation_method);
+    // Topics on nh, parameters on private_nh; used by the nodelet with its own handles
+    StereoImageProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& private_nh,
+                         int cv_interpolation_method);
+    // Stops the eye threads before the members their callbacks use are destroyed
+    ~StereoImageProcessor();
 
     void init();
     
     void connectInfoCallback(ros::Publisher& publisher, ros::Subscriber& subscriber, std::string side);
     void connectImageCallback(image_transport::Publisher& publisher, image_transport::Subscriber& subscriber, std::string side);
+    // With rectify, both outputs of an eye come from one raw image and camera_info subscription
+    void connectCameraCallback(image_transport::Publisher& image_publisher, ros::Publisher& info_publisher,
+                               image_transport::CameraSubscriber& subscriber, std::string side);
 
     void infoCallback(ros::Publisher& publisher, const sensor_msgs::CameraInfoConstPtr& info_msg);
     void imageCallback(image_transport::Publisher& publisher, const sensor_msgs::ImageConstPtr& image_msg);
+    void cameraCallback(image_transport::Publisher& image_publisher, ros::Publisher& info_publisher, int eye,
+                        const sensor_msgs::ImageConstPtr& image_msg, const sensor_msgs::CameraInfoConstPtr& info_msg);
+
+    // Output of the callbacks without publishing; the input itself when no resize or encoding
+    // change is needed, null if the image cannot be converted. Images keep their encoding
+    // unless output_encoding is set.
+    sensor_msgs::CameraInfoConstPtr resizeInfo(const sensor_msgs::CameraInfoConstPtr& info_msg);
+    sensor_msgs::ImageConstPtr resizeImage(const sensor_msgs::ImageConstPtr& image_msg);
+    // Undistorts, rectifies, crops and scales a raw image in one remap; resized_info is the
+    // resizeInfo of info_msg. eye selects the table, each eye must be handled by one thread at a time.
+    sensor_msgs::ImageConstPtr rectifyImage(int eye, const sensor_msgs::ImageConstPtr& image_msg,
+                                            const sensor_msgs::CameraInfoConstPtr& info_msg,
+                                            const sensor_msgs::CameraInfoConstPtr& resized_info);
+
+    // Overrides the width and height parameters
+    void setDesiredSize(int width, int height);
 
 private:
+    // Crop and scale from one input size to the desired size
+    struct ResizePlan {
+        int input_width = -1;
+        int input_height = -1;
+        int output_width = -1;
+        int output_height = -1;
+        cv::Rect roi;
+        double scale_x = 1.0;
+        double scale_y = 1.0;
+        int offset_x = 0;
+        int offset_y = 0;
+    };
+
+    // Resized CameraInfo of one eye, reused while its calibration is unchanged
+    struct InfoCacheEntry {
+        sensor_msgs::CameraInfoConstPtr input;
+        sensor_msgs::CameraInfoPtr output;
+    };
+
+    // Output pixel to raw image pixel for one eye, covering undistortion, rectification,
+    // crop and scale; rebuilt when the calibration or the output size changes
+    struct RectifyMap {
+        sensor_msgs::CameraInfoConstPtr info;
+        int output_width = -1;
+        int output_height = -1;
+        cv::Mat map_xy, map_fraction;
+    };
+
+    bool updateRectifyMap(RectifyMap& map, const sensor_msgs::CameraInfo& info, const sensor_msgs::CameraInfo& resized_info);
+
+    // Recomputed only when the input or desired size changes; call with plan_mutex held
+    const ResizePlan& resizePlan(int input_width, int input_height);
+    sensor_msgs::CameraInfoPtr buildResizedInfo(const sensor_msgs::CameraInfo& info, const ResizePlan& plan) const;
+    static bool sameCalibration(const sensor_msgs::CameraInfo& a, const sensor_msgs::CameraInfo& b);
+    // image_msg as a cv::Mat in encoding: its own data when the encodings match, else the
+    // converted copy held by converted. Logs and returns false if it can't be converted.
+    static bool inputImage(const sensor_msgs::ImageConstPtr& image_msg, const std::string& encoding,
+                           cv_bridge::CvImageConstPtr& converted, cv::Mat& image);
+    // Message of image in output_encoding, or in its own encoding if that conversion fails
+    sensor_msgs::ImageConstPtr outputImage(const cv_bridge::CvImageConstPtr& image) const;
+    // Encoding Bayer and packed YUV images are converted to when they can't be scaled as they are
+    std::string colorEncoding() const;
+    // Channel of the luma in packed 4:2:2 encodings, -1 for other encodings
+    static int packedYuvLumaChannel(const std::string& encoding);
+    // 0 for the left eye, 1 for the right
+    static int eyeIndex(const std::string& side);
+
     int desired_image_width;
     int desired_image_height;
     std::string input_camera;
+    // Empty to publish in the encoding of the input
+    std::string output_encoding;
+
+    // Interpolation from the constructor, overridden by the 'interpolation' parameter
+    ResizeEngine resize_engine;
+
+    std::mutex plan_mutex;
+    ResizePlan plan;
+    // One entry per eye, replaced in turn
+    InfoCacheEntry info_cache[2];
+    int next_info_entry;
 
-    int cv_interpolation_method;
+    // Subscribe to image_raw and build the output from the calibration instead of image_rect_color
+    bool rectify;
+    RectifyMap rectify_map[2];
+    image_transport::CameraSubscriber left_camera_subscriber, right_camera_subscriber;
+
+    // Output images of both eyes, a few each for intra-process subscribers still holding them
+    ImagePool image_pool;
 
     ros::NodeHandle public_nh;
     ros::NodeHandle private_nh;
 
     image_transport::ImageTransport transport;
+
+    // Subscriptions of each eye; with parallel_eyes, on a queue served by that eye's own
+    // thread so both eyes are processed at once and each in order
+    bool parallel_eyes;
+    ros::NodeHandle eye_nh[2];
+    std::unique_ptr<image_transport::ImageTransport> eye_transport[2];
+    ros::CallbackQueue eye_queue[2];
+    std::unique_ptr<ros::AsyncSpinner> eye_spinner[2];
     image_transport::Publisher left_image_publisher, right_image_publisher;
     ros::Publisher left_info_publisher, right_info_publisher;
     image_transport::Subscriber left_image_subscriber, right_image_subscriber;
     ros::Subscriber left_info_subscriber, right_info_subscriber;
 
     std::mutex transport_setup_mutex;
+
+    // Dumps the RVINCI_PROFILE_SCOPE timings of this node on ~dump_trace
+    rvinci_profiler::TraceService trace_service;
 };
 
 }
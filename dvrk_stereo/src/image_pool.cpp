@@ -0,0 +1,54 @@
+#include "image_pool.hpp"
+
+#include <boost/make_shared.hpp>
+
+namespace dvrk_stereo {
+
+ImagePool::ImagePool(size_t capacity)
+    : capacity(capacity)
+{
+    images.reserve(capacity);
+}
+
+sensor_msgs::ImagePtr ImagePool::acquire(const std_msgs::Header& header, int width, int height,
+                                         const std::string& encoding, int type) {
+    size_t step = static_cast<size_t>(width) * CV_ELEM_SIZE(type);
+    size_t data_size = step * height;
+
+    sensor_msgs::ImagePtr image;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        // A free message whose buffer is already large enough, else any free one
+        for (const auto& pooled : images) {
+            if (pooled.use_count() == 1) {
+                if (pooled->data.capacity() >= data_size) {
+                    image = pooled;
+                    break;
+                } else if (!image) {
+                    image = pooled;
+                }
+            }
+        }
+        if (!image) {
+            image = boost::make_shared<sensor_msgs::Image>();
+            if (images.size() < capacity) {
+                images.push_back(image);
+            }
+        }
+    }
+
+    image->header = header;
+    image->width = width;
+    image->height = height;
+    image->encoding = encoding;
+    image->is_bigendian = 0;
+    image->step = static_cast<uint32_t>(step);
+    image->data.resize(data_size);
+    return image;
+}
+
+cv::Mat ImagePool::view(sensor_msgs::Image& image, int type) {
+    return cv::Mat(image.height, image.width, type, image.data.data(), image.step);
+}
+
+}
@@ -0,0 +1,205 @@
+#include "resize_engine.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+namespace dvrk_stereo {
+
+namespace {
+
+// Rows are summed vertically into 16-bit lanes first: a widening add over
+// contiguous bytes, which the compiler turns into SIMD. Only the horizontal
+// sum of each block then steps by pixel.
+template <int factor>
+void boxDownscaleRows(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step,
+                      int width, int height, int channels) {
+    const int row_length = width * factor * channels;
+    // Kept per thread so steady state frames don't allocate
+    thread_local std::vector<uint16_t> sums;
+    sums.resize(row_length);
+    uint16_t* sum = sums.data();
+
+    for (int y = 0; y < height; ++y) {
+        const uint8_t* in = src + static_cast<size_t>(y) * factor * src_step;
+        for (int i = 0; i < row_length; ++i) {
+            sum[i] = in[i];
+        }
+        for (int k = 1; k < factor; ++k) {
+            const uint8_t* next = in + k * src_step;
+            for (int i = 0; i < row_length; ++i) {
+                sum[i] += next[i];
+            }
+        }
+
+        uint8_t* out = dst + static_cast<size_t>(y) * dst_step;
+        for (int x = 0; x < width; ++x) {
+            const uint16_t* block = sum + x * factor * channels;
+            for (int c = 0; c < channels; ++c) {
+                uint32_t total = block[c];
+                for (int k = 1; k < factor; ++k) {
+                    total += block[k * channels + c];
+                }
+                if (factor == 2) {
+                    out[x * channels + c] = static_cast<uint8_t>((total + 2) >> 2);
+                } else {
+                    // Division by 9 as a multiply; exact round-half-up for all sums up to 9*255
+                    out[x * channels + c] = static_cast<uint8_t>((total * 7282 + 32768) >> 16);
+                }
+            }
+        }
+    }
+}
+
+}
+
+void boxDownscale(const uint8_t* src, size_t src_step, uint8_t* dst, size_t dst_step,
+                  int width, int height, int channels, int factor) {
+    if (factor == 2) {
+        boxDownscaleRows<2>(src, src_step, dst, dst_step, width, height, channels);
+    } else if (factor == 3) {
+        boxDownscaleRows<3>(src, src_step, dst, dst_step, width, height, channels);
+    }
+}
+
+ResizeEngine::ResizeEngine(int cv_interpolation_method)
+    : cv_interpolation_method(cv_interpolation_method),
+      use_remap(false),
+      threads(1),
+      next_remap_table(0)
+{ }
+
+void ResizeEngine::setInterpolation(int cv_interpolation_method) {
+    this->cv_interpolation_method = cv_interpolation_method;
+}
+
+void ResizeEngine::setUseRemap(bool use_remap) {
+    this->use_remap = use_remap;
+}
+
+void ResizeEngine::setThreads(int threads) {
+    this->threads = std::max(1, threads);
+}
+
+int ResizeEngine::parseInterpolation(const std::string& name) {
+    if (name == "nearest") {
+        return cv::INTER_NEAREST;
+    } else if (name == "linear" || name == "bilinear") {
+        return cv::INTER_LINEAR;
+    } else if (name == "area") {
+        return cv::INTER_AREA;
+    } else if (name == "cubic") {
+        return cv::INTER_CUBIC;
+    }
+    return -1;
+}
+
+std::string ResizeEngine::interpolationName(int cv_interpolation_method) {
+    switch (cv_interpolation_method) {
+        case cv::INTER_NEAREST: return "nearest";
+        case cv::INTER_LINEAR: return "linear";
+        case cv::INTER_AREA: return "area";
+        case cv::INTER_CUBIC: return "cubic";
+        default: return "unknown";
+    }
+}
+
+void ResizeEngine::resize(const cv::Mat& image, const cv::Rect& roi, const cv::Size& size, cv::Mat& resized) {
+    cv::Mat cropped = image(roi);
+
+    if (cv_interpolation_method == cv::INTER_AREA && image.depth() == CV_8U) {
+        for (int factor = 2; factor <= 3; ++factor) {
+            if (roi.width == factor * size.width && roi.height == factor * size.height) {
+                resized.create(size, image.type());
+                // Bands of output rows, each reading its own factor times as many input rows
+                int bands = std::min(threads, size.height);
+                int channels = image.channels();
+                if (bands == 1) {
+                    boxDownscale(cropped.data, cropped.step, resized.data, resized.step,
+                                 size.width, size.height, channels, factor);
+                    return;
+                }
+                cv::parallel_for_(cv::Range(0, bands), [&](const cv::Range& range) {
+                    for (int band = range.start; band < range.end; ++band) {
+                        int first = size.height * band / bands;
+                        int last = size.height * (band + 1) / bands;
+                        boxDownscale(cropped.ptr(first * factor), cropped.step, resized.ptr(first), resized.step,
+                                     size.width, last - first, channels, factor);
+                    }
+                }, bands);
+                return;
+            }
+        }
+    }
+
+    // Remap has no area filter; area keeps going through cv::resize
+    if (use_remap && cv_interpolation_method != cv::INTER_AREA) {
+        cv::Mat xy, fraction;
+        {
+            std::lock_guard<std::mutex> lock(map_mutex);
+            const RemapTable& table = remapTable(image.size(), roi, size);
+            xy = table.xy;
+            fraction = table.fraction;
+        }
+        cv::remap(image, resized, xy, fraction, cv_interpolation_method, cv::BORDER_REPLICATE);
+        return;
+    }
+
+    cv::resize(cropped, resized, size, 0.0, 0.0, cv_interpolation_method);
+}
+
+void ResizeEngine::resizePackedYuv(const cv::Mat& image, const cv::Rect& roi, const cv::Size& size,
+                                   int luma_channel, cv::Mat& resized) {
+    // Intermediates are kept per thread and reused while the sizes don't change
+    thread_local cv::Mat luma, chroma, resized_luma, resized_chroma;
+    cv::extractChannel(image, luma, luma_channel);
+    // U and V alternate in the other channel; as two channels they form a half width image
+    cv::extractChannel(image, chroma, 1 - luma_channel);
+    cv::Mat chroma_pairs = chroma.reshape(2);
+    cv::Rect chroma_roi(roi.x / 2, roi.y, roi.width / 2, roi.height);
+
+    resize(luma, roi, size, resized_luma);
+    resize(chroma_pairs, chroma_roi, cv::Size(size.width / 2, size.height), resized_chroma);
+
+    cv::Mat planes[2];
+    planes[luma_channel] = resized_luma;
+    planes[1 - luma_channel] = resized_chroma.reshape(1);
+    cv::merge(planes, 2, resized);
+}
+
+const ResizeEngine::RemapTable& ResizeEngine::remapTable(const cv::Size& image_size, const cv::Rect& roi, const cv::Size& size) {
+    for (const auto& table : remap_tables) {
+        if (!table.xy.empty() && image_size == table.image_size && roi == table.roi && size == table.size) {
+            return table;
+        }
+    }
+
+    // Same pixel-centre alignment as cv::resize, offset into the full image by the crop
+    cv::Mat map_x(size, CV_32FC1);
+    cv::Mat map_y(size, CV_32FC1);
+    double scale_x = static_cast<double>(roi.width)/static_cast<double>(size.width);
+    double scale_y = static_cast<double>(roi.height)/static_cast<double>(size.height);
+    for (int y = 0; y < size.height; ++y) {
+        float* row_x = map_x.ptr<float>(y);
+        float* row_y = map_y.ptr<float>(y);
+        float source_y = static_cast<float>(roi.y + (y + 0.5)*scale_y - 0.5);
+        for (int x = 0; x < size.width; ++x) {
+            row_x[x] = static_cast<float>(roi.x + (x + 0.5)*scale_x - 0.5);
+            row_y[x] = source_y;
+        }
+    }
+    RemapTable& table = remap_tables[next_remap_table];
+    next_remap_table = (next_remap_table + 1) % 2;
+    table.xy.release();
+    table.fraction.release();
+    cv::convertMaps(map_x, map_y, table.xy, table.fraction, CV_16SC2);
+
+    table.image_size = image_size;
+    table.roi = roi;
+    table.size = size;
+    return table;
+}
+
+}
@@ -1,22 +1,58 @@
 #include "stereo_proc.hpp"
 
+#include <opencv2/core/utility.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/calib3d.hpp>
 #include <opencv2/imgproc.hpp>
 #include <cv_bridge/cv_bridge.h>
+#include <boost/make_shared.hpp>
+#include <sensor_msgs/image_encodings.h>
 
 namespace dvrk_stereo {
 
 StereoImageProcessor::StereoImageProcessor() : StereoImageProcessor(cv::INTER_AREA) { }
 
 StereoImageProcessor::StereoImageProcessor(int cv_interpolation_method)
+    : StereoImageProcessor(ros::NodeHandle(), ros::NodeHandle("~"), cv_interpolation_method) { }
+
+StereoImageProcessor::StereoImageProcessor(const ros::NodeHandle& nh, const ros::NodeHandle& private_nh,
+                                           int cv_interpolation_method)
     : desired_image_width(0),
       desired_image_height(0),
       input_camera(""),
-      cv_interpolation_method(cv_interpolation_method),
-      private_nh("~"),
-      transport(public_nh)
+      resize_engine(cv_interpolation_method),
+      next_info_entry(0),
+      rectify(false),
+      image_pool(8),
+      public_nh(nh),
+      private_nh(private_nh),
+      transport(public_nh),
+      parallel_eyes(true)
 { }
 
+StereoImageProcessor::~StereoImageProcessor() {
+    // No new connect callbacks once unadvertised; one already running finishes before the lock is taken
+    left_image_publisher.shutdown();
+    right_image_publisher.shutdown();
+    left_info_publisher.shutdown();
+    right_info_publisher.shutdown();
+    {
+        std::lock_guard<std::mutex> lock(transport_setup_mutex);
+        left_image_subscriber.shutdown();
+        right_image_subscriber.shutdown();
+        left_info_subscriber.shutdown();
+        right_info_subscriber.shutdown();
+        left_camera_subscriber.shutdown();
+        right_camera_subscriber.shutdown();
+    }
+    // Joins the eye threads, including a callback in progress
+    for (int eye = 0; eye < 2; ++eye) {
+        if (eye_spinner[eye]) {
+            eye_spinner[eye]->stop();
+        }
+    }
+}
+
 void StereoImageProcessor::init() {
     // Get parameters
     private_nh.param("width", desired_image_width, 0);
@@ -26,11 +62,70 @@ void StereoImageProcessor::init() {
         ROS_ERROR("Required parameter '_camera' not specified");
     }
 
+    std::string interpolation;
+    private_nh.param("interpolation", interpolation, ResizeEngine::interpolationName(resize_engine.interpolation()));
+    int cv_interpolation_method = ResizeEngine::parseInterpolation(interpolation);
+    if (cv_interpolation_method < 0) {
+        ROS_ERROR("Unknown interpolation '%s', expected nearest, linear, area or cubic", interpolation.c_str());
+    } else {
+        resize_engine.setInterpolation(cv_interpolation_method);
+    }
+    bool use_remap;
+    private_nh.param("use_remap", use_remap, false);
+    resize_engine.setUseRemap(use_remap);
+    int resize_threads = 1;
+    bool threads_specified = private_nh.getParam("resize_threads", resize_threads);
+    resize_engine.setThreads(resize_threads);
+    // The OpenCV thread count is process wide, shared with other nodelets; only change it when asked to
+    if (threads_specified) {
+        cv::setNumThreads(resize_threads);
+    }
+
+    private_nh.param("rectify", rectify, false);
+    private_nh.param("output_encoding", output_encoding, std::string());
+
+    private_nh.param("parallel_eyes", parallel_eyes, true);
+    for (int eye = 0; eye < 2; ++eye) {
+        eye_nh[eye] = public_nh;
+        if (parallel_eyes) {
+            eye_nh[eye].setCallbackQueue(&eye_queue[eye]);
+            // One thread per queue keeps each eye in order
+            eye_spinner[eye].reset(new ros::AsyncSpinner(1, &eye_queue[eye]));
+            eye_spinner[eye]->start();
+        }
+        eye_transport[eye].reset(new image_transport::ImageTransport(eye_nh[eye]));
+    }
+    trace_service.advertise(private_nh, "stereo_proc");
+
     //auto left_connect_info = std::bind(&StereoImageProcessor::connectInfoCallback, this, left_info_publisher, left_info_subscriber, "left");
-    auto left_connect_info = [&](const ros::SingleSubscriberPublisher& _) { connectInfoCallback(left_info_publisher, left_info_subscriber, "left"); };
-    auto right_connect_info = [&](const ros::SingleSubscriberPublisher& _) { connectInfoCallback(right_info_publisher, right_info_subscriber, "right"); };
-    auto left_connect_image = [&](const image_transport::SingleSubscriberPublisher& _) { connectImageCallback(left_image_publisher, left_image_subscriber, "left"); };
-    auto right_connect_image = [&](const image_transport::SingleSubscriberPublisher& _) { connectImageCallback(right_image_publisher, right_image_subscriber, "right"); };
+    auto left_connect_info = [&](const ros::SingleSubscriberPublisher& _) {
+        if (rectify) {
+            connectCameraCallback(left_image_publisher, left_info_publisher, left_camera_subscriber, "left");
+        } else {
+            connectInfoCallback(left_info_publisher, left_info_subscriber, "left");
+        }
+    };
+    auto right_connect_info = [&](const ros::SingleSubscriberPublisher& _) {
+        if (rectify) {
+            connectCameraCallback(right_image_publisher, right_info_publisher, right_camera_subscriber, "right");
+        } else {
+            connectInfoCallback(right_info_publisher, right_info_subscriber, "right");
+        }
+    };
+    auto left_connect_image = [&](const image_transport::SingleSubscriberPublisher& _) {
+        if (rectify) {
+            connectCameraCallback(left_image_publisher, left_info_publisher, left_camera_subscriber, "left");
+        } else {
+            connectImageCallback(left_image_publisher, left_image_subscriber, "left");
+        }
+    };
+    auto right_connect_image = [&](const image_transport::SingleSubscriberPublisher& _) {
+        if (rectify) {
+            connectCameraCallback(right_image_publisher, right_info_publisher, right_camera_subscriber, "right");
+        } else {
+            connectImageCallback(right_image_publisher, right_image_subscriber, "right");
+        }
+    };
 
     // Ensure connectCallback isn't entered before camera publishers are set up completely
     std::lock_guard<std::mutex> lock(transport_setup_mutex);
@@ -48,7 +143,7 @@ void StereoImageProcessor::connectInfoCallback(ros::Publisher& publisher, ros::S
     } else if (!subscriber) {
         // Bind callback to specific left/right publisher
         auto info_callback = [&](const sensor_msgs::CameraInfoConstPtr& msg) { infoCallback(publisher, msg); };
-        subscriber = public_nh.subscribe<sensor_msgs::CameraInfo>(input_camera + "/" + side + "/camera_info", 1, info_callback);
+        subscriber = eye_nh[eyeIndex(side)].subscribe<sensor_msgs::CameraInfo>(input_camera + "/" + side + "/camera_info", 1, info_callback);
     }
 }
 
@@ -60,58 +155,141 @@ void StereoImageProcessor::connectImageCallback(image_transport::Publisher& publ
     } else if (!subscriber) {
         // Bind callback to specific left/right publisher
         auto image_callback = [&](const sensor_msgs::ImageConstPtr& msg) { imageCallback(publisher, msg); };
-        subscriber = transport.subscribe(input_camera + "/" + side + "/image_rect_color", 1, image_callback);
+        subscriber = eye_transport[eyeIndex(side)]->subscribe(input_camera + "/" + side + "/image_rect_color", 1, image_callback);
     }
 }
 
-void StereoImageProcessor::infoCallback(ros::Publisher& publisher, const sensor_msgs::CameraInfoConstPtr& info_msg) {
-    bool no_desired_size = (desired_image_width == 0) || (desired_image_height == 0);
-    bool correct_size = (info_msg->width == desired_image_width) && (info_msg->height == desired_image_height);
+void StereoImageProcessor::connectCameraCallback(image_transport::Publisher& image_publisher, ros::Publisher& info_publisher,
+                                                 image_transport::CameraSubscriber& subscriber, std::string side) {
+    std::lock_guard<std::mutex> lock(transport_setup_mutex);
 
-    if (no_desired_size || correct_size) {
-        publisher.publish(info_msg);
-        return;
+    if (image_publisher.getNumSubscribers() == 0 && info_publisher.getNumSubscribers() == 0) {
+        subscriber.shutdown();
+    } else if (!subscriber) {
+        int eye = eyeIndex(side);
+        auto camera_callback = [&, eye](const sensor_msgs::ImageConstPtr& image_msg, const sensor_msgs::CameraInfoConstPtr& info_msg) {
+            cameraCallback(image_publisher, info_publisher, eye, image_msg, info_msg);
+        };
+        subscriber = eye_transport[eye]->subscribeCamera(input_camera + "/" + side + "/image_raw", 1, camera_callback);
+    }
+}
+
+int StereoImageProcessor::eyeIndex(const std::string& side) {
+    return (side == "left") ? 0 : 1;
+}
+
+void StereoImageProcessor::setDesiredSize(int width, int height) {
+    std::lock_guard<std::mutex> lock(plan_mutex);
+    desired_image_width = width;
+    desired_image_height = height;
+    // Cached infos were built for the previous size
+    for (auto& entry : info_cache) {
+        entry = InfoCacheEntry();
     }
+}
+
+const StereoImageProcessor::ResizePlan& StereoImageProcessor::resizePlan(int input_width, int input_height) {
+    if ((plan.input_width == input_width) && (plan.input_height == input_height)
+        && (plan.output_width == desired_image_width) && (plan.output_height == desired_image_height)) {
+        return plan;
+    }
+
+    plan = ResizePlan();
+    plan.input_width = input_width;
+    plan.input_height = input_height;
+    plan.output_width = desired_image_width;
+    plan.output_height = desired_image_height;
 
     double desired_aspect_ratio = static_cast<double>(desired_image_width)/static_cast<double>(desired_image_height);
-    double current_aspect_ratio = static_cast<double>(info_msg->width)/static_cast<double>(info_msg->height);
-   
+    double current_aspect_ratio = static_cast<double>(input_width)/static_cast<double>(input_height);
+
     int crop_x = 0;
     int crop_y = 0;
-    int width = info_msg->width;
-    int height = info_msg->height;
- 
-    // Want image to be narrower, crop width
+    int width = input_width;
+    int height = input_height;
+
+    // Want image to be narrower, crop width. Offset and width stay even so a packed 4:2:2
+    // crop starts and ends on a whole chroma pair; the info is built from the same plan.
     if (desired_aspect_ratio < current_aspect_ratio) {
-        width = desired_aspect_ratio*info_msg->height;
-        crop_x = (info_msg->width - width)/2;
+        width = static_cast<int>(desired_aspect_ratio*input_height) & ~1;
+        crop_x = ((input_width - width)/2) & ~1;
     // Want image to be shorter, crop height
     } else {
-        height = info_msg->width/desired_aspect_ratio;
-        crop_y = (info_msg->height - height)/2;
+        height = input_width/desired_aspect_ratio;
+        crop_y = (input_height - height)/2;
+    }
+
+    plan.roi = cv::Rect(crop_x, crop_y, width, height);
+    plan.scale_x = static_cast<double>(desired_image_width)/static_cast<double>(width);
+    plan.offset_x = static_cast<int>(-crop_x * plan.scale_x);
+    plan.scale_y = static_cast<double>(desired_image_height)/static_cast<double>(height);
+    plan.offset_y = static_cast<int>(-crop_y * plan.scale_y);
+
+    return plan;
+}
+
+void StereoImageProcessor::infoCallback(ros::Publisher& publisher, const sensor_msgs::CameraInfoConstPtr& info_msg) {
+    publisher.publish(resizeInfo(info_msg));
+}
+
+sensor_msgs::CameraInfoConstPtr StereoImageProcessor::resizeInfo(const sensor_msgs::CameraInfoConstPtr& info_msg) {
+    std::lock_guard<std::mutex> lock(plan_mutex);
+    bool no_desired_size = (desired_image_width == 0) || (desired_image_height == 0);
+    bool correct_size = (info_msg->width == desired_image_width) && (info_msg->height == desired_image_height);
+
+    if (no_desired_size || correct_size) {
+        return info_msg;
     }
 
-    sensor_msgs::CameraInfoPtr resized_info(new sensor_msgs::CameraInfo(*info_msg));
-    double scale_x = static_cast<double>(desired_image_width)/static_cast<double>(width);
-    int offset_x = static_cast<int>(-crop_x * scale_x);
-    double scale_y = static_cast<double>(desired_image_height)/static_cast<double>(height);
-    int offset_y = static_cast<int>(-crop_y * scale_y);
+    InfoCacheEntry* entry = nullptr;
+    for (auto& cached : info_cache) {
+        if (cached.input && sameCalibration(*cached.input, *info_msg)) {
+            entry = &cached;
+            break;
+        }
+    }
+    if (!entry) {
+        entry = &info_cache[next_info_entry];
+        next_info_entry = (next_info_entry + 1) % 2;
+        entry->input = info_msg;
+        entry->output = buildResizedInfo(*info_msg, resizePlan(info_msg->width, info_msg->height));
+    } else if (entry->output.use_count() > 1) {
+        // An intra-process subscriber still holds the last one, don't change it under them
+        entry->output = boost::make_shared<sensor_msgs::CameraInfo>(*entry->output);
+    }
+
+    entry->output->header = info_msg->header;
+    return entry->output;
+}
+
+bool StereoImageProcessor::sameCalibration(const sensor_msgs::CameraInfo& a, const sensor_msgs::CameraInfo& b) {
+    return (a.width == b.width) && (a.height == b.height)
+        && (a.distortion_model == b.distortion_model) && (a.D == b.D)
+        && (a.K == b.K) && (a.R == b.R) && (a.P == b.P)
+        && (a.binning_x == b.binning_x) && (a.binning_y == b.binning_y)
+        && (a.roi.x_offset == b.roi.x_offset) && (a.roi.y_offset == b.roi.y_offset)
+        && (a.roi.width == b.roi.width) && (a.roi.height == b.roi.height)
+        && (a.roi.do_rectify == b.roi.do_rectify);
+}
+
+sensor_msgs::CameraInfoPtr StereoImageProcessor::buildResizedInfo(const sensor_msgs::CameraInfo& info, const ResizePlan& plan) const {
+    sensor_msgs::CameraInfoPtr resized_info(new sensor_msgs::CameraInfo(info));
     
-    resized_info->width = desired_image_width;
-    resized_info->height = desired_image_height;
+    resized_info->width = plan.output_width;
+    resized_info->height = plan.output_height;
 
     // Entries other than 0, 2, 4, 5 are 0.0
-    resized_info->K[0] = info_msg->K[0] * scale_x;            // fx
-    resized_info->K[2] = info_msg->K[2] * scale_x + offset_x; // cx
-    resized_info->K[4] = info_msg->K[4] * scale_y;            // fy
-    resized_info->K[5] = info_msg->K[5] * scale_y + offset_y; // cy
+    resized_info->K[0] = info.K[0] * plan.scale_x;                 // fx
+    resized_info->K[2] = info.K[2] * plan.scale_x + plan.offset_x; // cx
+    resized_info->K[4] = info.K[4] * plan.scale_y;                 // fy
+    resized_info->K[5] = info.K[5] * plan.scale_y + plan.offset_y; // cy
 
     // Entries other than 0, 2, 3, 5, 6 are 0.0
-    resized_info->P[0] = info_msg->P[0] * scale_x;            // fx
-    resized_info->P[2] = info_msg->P[2] * scale_x + offset_x; // cx
-    resized_info->P[3] = info_msg->P[3] * scale_x; // Tx
-    resized_info->P[5] = info_msg->P[5] * scale_y;            // fy
-    resized_info->P[6] = info_msg->P[6] * scale_y + offset_y; // cy
+    resized_info->P[0] = info.P[0] * plan.scale_x;                 // fx
+    resized_info->P[2] = info.P[2] * plan.scale_x + plan.offset_x; // cx
+    resized_info->P[3] = info.P[3] * plan.scale_x; // Tx
+    resized_info->P[5] = info.P[5] * plan.scale_y;                 // fy
+    resized_info->P[6] = info.P[6] * plan.scale_y + plan.offset_y; // cy
 
     // Since we've cropped, we can't necessarily respect ROI, so set to full image
     resized_info->roi.x_offset = 0;
@@ -119,72 +297,230 @@ void StereoImageProcessor::infoCallback(ros::Publisher& publisher, const sensor_
     resized_info->roi.width = 0;
     resized_info->roi.height = 0;
 
-    publisher.publish(resized_info);
+    return resized_info;
 }
 
 void StereoImageProcessor::imageCallback(image_transport::Publisher& publisher, const sensor_msgs::ImageConstPtr& image_msg) {
-    bool no_desired_size = (desired_image_width == 0) || (desired_image_height == 0);
-    bool correct_size = (image_msg->width == desired_image_width) && (image_msg->height == desired_image_height);
-
-    if (no_desired_size || correct_size) {
-        publisher.publish(image_msg);
+    RVINCI_PROFILE_SCOPE("StereoImageProcessor::imageCallback");
+    sensor_msgs::ImageConstPtr out_msg = resizeImage(image_msg);
+    if (!out_msg) {
         return;
     }
+    publisher.publish(out_msg);
 
-    cv_bridge::CvImageConstPtr in_image;
-    cv_bridge::CvImage resized_image;
-    resized_image.header = image_msg->header;
-    resized_image.encoding = "rgb8";
-    
-    try {
-        in_image = cv_bridge::toCvShare(image_msg, "rgb8");
-    } catch (cv_bridge::Exception& e) {
-        ROS_ERROR("Could not convert from '%s' to 'rgb8'", image_msg->encoding.c_str());
+    // Resize share of the video latency; rvinci measures the rest from the same header stamp
+    ROS_DEBUG_STREAM_NAMED("latency", publisher.getTopic() << ": "
+                           << (ros::Time::now() - image_msg->header.stamp).toSec() * 1000.0
+                           << " ms from capture to publish");
+}
+
+void StereoImageProcessor::cameraCallback(image_transport::Publisher& image_publisher, ros::Publisher& info_publisher, int eye,
+                                          const sensor_msgs::ImageConstPtr& image_msg, const sensor_msgs::CameraInfoConstPtr& info_msg) {
+    RVINCI_PROFILE_SCOPE("StereoImageProcessor::cameraCallback");
+    sensor_msgs::CameraInfoConstPtr resized_info = resizeInfo(info_msg);
+    sensor_msgs::ImageConstPtr out_msg = rectifyImage(eye, image_msg, info_msg, resized_info);
+    if (!out_msg) {
+        return;
     }
+    image_publisher.publish(out_msg);
+    info_publisher.publish(resized_info);
 
-    double desired_aspect_ratio = static_cast<double>(desired_image_width)/static_cast<double>(desired_image_height);
-    double current_aspect_ratio = static_cast<double>(image_msg->width)/static_cast<double>(image_msg->height);
-   
+    ROS_DEBUG_STREAM_NAMED("latency", image_publisher.getTopic() << ": "
+                           << (ros::Time::now() - image_msg->header.stamp).toSec() * 1000.0
+                           << " ms from capture to publish");
+}
+
+sensor_msgs::ImageConstPtr StereoImageProcessor::resizeImage(const sensor_msgs::ImageConstPtr& image_msg) {
+    // The other eye's thread may change the size, take it and its plan together
+    cv::Size size;
     cv::Rect ROI;
-    int crop_x = 0;
-    int crop_y = 0;
-    int width = image_msg->width;
-    int height = image_msg->height;
- 
-    // Want image to be narrower, crop width
-    if (desired_aspect_ratio < current_aspect_ratio) {
-        width = desired_aspect_ratio*image_msg->height;
-        crop_x = (image_msg->width - width)/2;
-        ROI = cv::Rect(crop_x, 0, width, image_msg->height);
-    // Want image to be shorter, crop height
+    bool no_desired_size;
+    bool correct_size;
+    {
+        std::lock_guard<std::mutex> lock(plan_mutex);
+        size = cv::Size(desired_image_width, desired_image_height);
+        no_desired_size = (size.width == 0) || (size.height == 0);
+        correct_size = (image_msg->width == size.width) && (image_msg->height == size.height);
+        if (!no_desired_size && !correct_size) {
+            ROI = resizePlan(image_msg->width, image_msg->height).roi;
+        }
+    }
+    bool correct_encoding = output_encoding.empty() || (output_encoding == image_msg->encoding);
+
+    if ((no_desired_size || correct_size) && correct_encoding) {
+        return image_msg;
+    }
+
+    // Scale in the source encoding; Bayer has to be interpolated first, and packed YUV
+    // can only be scaled to an even width
+    int luma_channel = packedYuvLumaChannel(image_msg->encoding);
+    std::string encoding = image_msg->encoding;
+    if (sensor_msgs::image_encodings::isBayer(encoding) || (luma_channel >= 0 && size.width % 2 != 0)) {
+        encoding = colorEncoding();
+        luma_channel = -1;
+    }
+
+    cv_bridge::CvImageConstPtr converted;
+    cv::Mat in_image;
+    if (!inputImage(image_msg, encoding, converted, in_image)) {
+        return sensor_msgs::ImageConstPtr();
+    }
+    if (no_desired_size || correct_size) {
+        return outputImage(boost::make_shared<cv_bridge::CvImage>(image_msg->header, encoding, in_image));
+    }
+
+    // Scale straight into a pooled message, unless it is converted afterwards
+    sensor_msgs::ImagePtr out_msg;
+    cv::Mat resized;
+    if (output_encoding.empty() || (output_encoding == encoding)) {
+        out_msg = image_pool.acquire(image_msg->header, size.width, size.height, encoding, in_image.type());
+        resized = ImagePool::view(*out_msg, in_image.type());
+    }
+
+    // Crop and scale to desired size while maintaining aspect ratio
+    if (luma_channel >= 0) {
+        resize_engine.resizePackedYuv(in_image, ROI, size, luma_channel, resized);
     } else {
-        height = image_msg->width/desired_aspect_ratio;
-        crop_y = (image_msg->height - height)/2;
-        ROI = cv::Rect(0, crop_y, image_msg->width, height);
+        resize_engine.resize(in_image, ROI, size, resized);
     }
 
-    // Crop
-    cv::Mat cropped = in_image->image(ROI);
+    if (out_msg) {
+        return out_msg;
+    }
+    return outputImage(boost::make_shared<cv_bridge::CvImage>(image_msg->header, encoding, resized));
+}
 
-    // Scale to desired size while maintaining aspect ratio
-    cv::Size size(desired_image_width, desired_image_height);
-    cv::resize(cropped, resized_image.image, size, 0.0, 0.0, cv::INTER_CUBIC);
+bool StereoImageProcessor::inputImage(const sensor_msgs::ImageConstPtr& image_msg, const std::string& encoding,
+                                      cv_bridge::CvImageConstPtr& converted, cv::Mat& image) {
+    if ((encoding == image_msg->encoding) && !image_msg->is_bigendian) {
+        // Shares the message data, image_msg keeps it alive
+        try {
+            int type = cv_bridge::getCvType(encoding);
+            image = cv::Mat(image_msg->height, image_msg->width, type,
+                            const_cast<uint8_t*>(image_msg->data.data()), image_msg->step);
+            return true;
+        } catch (cv_bridge::Exception& e) {
+            // Not a plain pixel layout, let toCvShare handle it
+        }
+    }
+    try {
+        converted = cv_bridge::toCvShare(image_msg, encoding);
+    } catch (cv_bridge::Exception& e) {
+        ROS_ERROR("Could not convert from '%s' to '%s'", image_msg->encoding.c_str(), encoding.c_str());
+        return false;
+    }
+    image = converted->image;
+    return true;
+}
 
-    auto out_msg = resized_image.toImageMsg();
-    publisher.publish(out_msg);
+std::string StereoImageProcessor::colorEncoding() const {
+    return sensor_msgs::image_encodings::isColor(output_encoding) ? output_encoding : sensor_msgs::image_encodings::RGB8;
 }
 
+int StereoImageProcessor::packedYuvLumaChannel(const std::string& encoding) {
+    if (encoding == sensor_msgs::image_encodings::YUV422) {
+        return 1; // UYVY
+    } else if (encoding == "yuv422_yuy2") {
+        return 0; // YUYV
+    }
+    return -1;
 }
 
-int main(int argc, char **argv) {
-    ros::init(argc, argv, "stereo_proc");
-    
-    dvrk_stereo::StereoImageProcessor stereo_processor;
-    stereo_processor.init();
+sensor_msgs::ImageConstPtr StereoImageProcessor::outputImage(const cv_bridge::CvImageConstPtr& image) const {
+    if (output_encoding.empty() || (output_encoding == image->encoding)) {
+        return image->toImageMsg();
+    }
+    try {
+        return cv_bridge::cvtColor(image, output_encoding)->toImageMsg();
+    } catch (cv_bridge::Exception& e) {
+        ROS_ERROR_THROTTLE(5.0, "Could not convert from '%s' to '%s', publishing '%s'",
+                           image->encoding.c_str(), output_encoding.c_str(), image->encoding.c_str());
+        return image->toImageMsg();
+    }
+}
 
-    ros::spin();
+bool StereoImageProcessor::updateRectifyMap(RectifyMap& map, const sensor_msgs::CameraInfo& info,
+                                            const sensor_msgs::CameraInfo& resized_info) {
+    if (map.info && sameCalibration(*map.info, info)
+        && (map.output_width == static_cast<int>(resized_info.width))
+        && (map.output_height == static_cast<int>(resized_info.height))) {
+        return true;
+    }
+
+    map = RectifyMap();
+    cv::Matx33d K(info.K.data());
+    cv::Matx33d R(info.R.data());
+    cv::Mat D(info.D, true);
+    // The resized projection already holds the crop and scale, so each output pixel maps
+    // straight to the raw image
+    cv::Matx34d P(resized_info.P.data());
+    cv::Matx33d new_camera_matrix = P.get_minor<3, 3>(0, 0);
+    cv::Size size(resized_info.width, resized_info.height);
+
+    if (info.distortion_model == "equidistant") {
+        if (D.total() != 4) {
+            ROS_ERROR("Equidistant distortion needs 4 coefficients, camera info has %zu", D.total());
+            return false;
+        }
+        cv::fisheye::initUndistortRectifyMap(K, D, R, new_camera_matrix, size, CV_16SC2, map.map_xy, map.map_fraction);
+    } else if (info.distortion_model == "plumb_bob" || info.distortion_model == "rational_polynomial" || D.empty()) {
+        cv::initUndistortRectifyMap(K, D, R, new_camera_matrix, size, CV_16SC2, map.map_xy, map.map_fraction);
+    } else {
+        ROS_ERROR("Unsupported distortion model '%s'", info.distortion_model.c_str());
+        return false;
+    }
 
-    return 0;
+    map.info = boost::make_shared<sensor_msgs::CameraInfo>(info);
+    map.output_width = size.width;
+    map.output_height = size.height;
+    return true;
 }
 
+sensor_msgs::ImageConstPtr StereoImageProcessor::rectifyImage(int eye, const sensor_msgs::ImageConstPtr& image_msg,
+                                                              const sensor_msgs::CameraInfoConstPtr& info_msg,
+                                                              const sensor_msgs::CameraInfoConstPtr& resized_info) {
+    if (info_msg->K[0] == 0.0) {
+        ROS_ERROR_THROTTLE(5.0, "Camera is not calibrated, publishing '%s' without rectification", image_msg->header.frame_id.c_str());
+        return resizeImage(image_msg);
+    }
+    if ((image_msg->width != info_msg->width) || (image_msg->height != info_msg->height)) {
+        ROS_ERROR_THROTTLE(5.0, "Image is %ux%u but camera info is for %ux%u", image_msg->width, image_msg->height,
+                           info_msg->width, info_msg->height);
+        return sensor_msgs::ImageConstPtr();
+    }
+
+    // Remap in the source encoding, except Bayer and packed YUV which don't sample per pixel
+    std::string encoding = image_msg->encoding;
+    if (sensor_msgs::image_encodings::isBayer(encoding) || packedYuvLumaChannel(encoding) >= 0) {
+        encoding = colorEncoding();
+    }
 
+    cv_bridge::CvImageConstPtr converted;
+    cv::Mat in_image;
+    if (!inputImage(image_msg, encoding, converted, in_image)) {
+        return sensor_msgs::ImageConstPtr();
+    }
+
+    RectifyMap& map = rectify_map[eye];
+    if (!updateRectifyMap(map, *info_msg, *resized_info)) {
+        return sensor_msgs::ImageConstPtr();
+    }
+
+    // Remap has no area filter, linear is the closest
+    int method = resize_engine.interpolation();
+    if (method == cv::INTER_AREA) {
+        method = cv::INTER_LINEAR;
+    }
+    if (output_encoding.empty() || (output_encoding == encoding)) {
+        sensor_msgs::ImagePtr out_msg = image_pool.acquire(image_msg->header, resized_info->width, resized_info->height,
+                                                           encoding, in_image.type());
+        cv::Mat rectified = ImagePool::view(*out_msg, in_image.type());
+        cv::remap(in_image, rectified, map.map_xy, map.map_fraction, method, cv::BORDER_CONSTANT);
+        return out_msg;
+    }
+    cv::Mat rectified;
+    cv::remap(in_image, rectified, map.map_xy, map.map_fraction, method, cv::BORDER_CONSTANT);
+    return outputImage(boost::make_shared<cv_bridge::CvImage>(image_msg->header, encoding, rectified));
+}
+
+}
@@ -0,0 +1,12 @@
+#include "stereo_proc.hpp"
+
+int main(int argc, char **argv) {
+    ros::init(argc, argv, "stereo_proc");
+    
+    dvrk_stereo::StereoImageProcessor stereo_processor;
+    stereo_processor.init();
+
+    ros::spin();
+
+    return 0;
+}
@@ -0,0 +1,26 @@
+#include <memory>
+
+#include <nodelet/nodelet.h>
+#include <opencv2/imgproc.hpp>
+#include <pluginlib/class_list_macros.h>
+
+#include "stereo_proc.hpp"
+
+namespace dvrk_stereo {
+
+// StereoImageProcessor loaded into the nodelet manager of the camera pipeline.
+// Images from nodelets in the same manager arrive as shared pointers without
+// serialization, and are forwarded the same way when no resize is needed.
+class StereoProcNodelet : public nodelet::Nodelet {
+private:
+    void onInit() override {
+        processor.reset(new StereoImageProcessor(getMTNodeHandle(), getMTPrivateNodeHandle(), cv::INTER_AREA));
+        processor->init();
+    }
+
+    std::unique_ptr<StereoImageProcessor> processor;
+};
+
+}
+
+PLUGINLIB_EXPORT_CLASS(dvrk_stereo::StereoProcNodelet, nodelet::Nodelet)
@@ -0,0 +1,162 @@
+#include "stereo_proc.hpp"
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <boost/make_shared.hpp>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <string>
+
+// Steady state frames scaled in their own encoding must not touch the heap.
+// The C allocator is replaced for this whole executable, so operator new and
+// cv::fastMalloc, which sits on malloc or posix_memalign, are both counted.
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* pointer, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+void __libc_free(void* pointer);
+}
+
+namespace {
+
+// Heap allocations made by the current thread; ROS background threads are not counted
+thread_local size_t allocations = 0;
+
+}
+
+extern "C" {
+
+void* malloc(size_t size) {
+    ++allocations;
+    return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+    ++allocations;
+    return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+    ++allocations;
+    return __libc_realloc(pointer, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    ++allocations;
+    return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    ++allocations;
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** pointer, size_t alignment, size_t size) {
+    ++allocations;
+    // Same contract as glibc, which __libc_memalign does not check
+    if ((alignment % sizeof(void*) != 0) || ((alignment & (alignment - 1)) != 0) || (alignment == 0)) {
+        return EINVAL;
+    }
+    void* allocated = __libc_memalign(alignment, size);
+    if (!allocated) {
+        return ENOMEM;
+    }
+    *pointer = allocated;
+    return 0;
+}
+
+void free(void* pointer) {
+    __libc_free(pointer);
+}
+
+}
+
+namespace {
+
+const int frames = 8;
+
+sensor_msgs::ImagePtr makeImage(int width, int height, const std::string& encoding) {
+    namespace enc = sensor_msgs::image_encodings;
+    sensor_msgs::ImagePtr image = boost::make_shared<sensor_msgs::Image>();
+    image->header.frame_id = "allocation_test";
+    image->width = width;
+    image->height = height;
+    image->encoding = encoding;
+    image->step = width * enc::numChannels(encoding) * enc::bitDepth(encoding) / 8;
+    image->data.resize(static_cast<size_t>(image->step) * height);
+    for (size_t i = 0; i < image->data.size(); ++i) {
+        image->data[i] = static_cast<uint8_t>((i * 7) ^ (i >> 9));
+    }
+    return image;
+}
+
+// Scales frames after a first one that fills the pool and the per thread buffers;
+// returns the allocations they made and checks they all reuse the first message's buffer
+size_t steadyStateAllocations(int method, const std::string& encoding, int in_width, int in_height,
+                              int out_width, int out_height) {
+    dvrk_stereo::StereoImageProcessor processor(method);
+    processor.setDesiredSize(out_width, out_height);
+    sensor_msgs::ImagePtr image = makeImage(in_width, in_height, encoding);
+
+    const uint8_t* first_data = nullptr;
+    {
+        sensor_msgs::ImageConstPtr resized = processor.resizeImage(image);
+        EXPECT_TRUE(resized);
+        if (!resized) {
+            return 0;
+        }
+        EXPECT_EQ(resized->encoding, encoding);
+        first_data = resized->data.data();
+    }
+
+    // Nothing that may allocate, gtest included, runs while counting
+    const uint8_t* data[frames];
+    size_t first_allocation = allocations;
+    for (int frame = 0; frame < frames; ++frame) {
+        image->header.seq++;
+        sensor_msgs::ImageConstPtr resized = processor.resizeImage(image);
+        data[frame] = resized ? resized->data.data() : nullptr;
+    }
+    size_t steady_allocations = allocations - first_allocation;
+
+    for (int frame = 0; frame < frames; ++frame) {
+        EXPECT_EQ(data[frame], first_data) << "frame " << frame;
+    }
+    return steady_allocations;
+}
+
+const char* const encodings[] = {"rgb8", "bgr8", "bgra8", "mono8", "yuv422"};
+
+}
+
+TEST(Allocations, HookCountsOpenCvBuffers) {
+    size_t first_allocation = allocations;
+    cv::Mat image(64, 64, CV_8UC3);
+    EXPECT_GT(allocations, first_allocation);
+}
+
+TEST(Allocations, AreaHalfScaleIsAllocationFree) {
+    for (const char* encoding : encodings) {
+        SCOPED_TRACE(encoding);
+        EXPECT_EQ(steadyStateAllocations(cv::INTER_AREA, encoding, 1920, 1080, 960, 540), 0u);
+    }
+}
+
+TEST(Allocations, AreaThirdScaleIsAllocationFree) {
+    for (const char* encoding : encodings) {
+        SCOPED_TRACE(encoding);
+        EXPECT_EQ(steadyStateAllocations(cv::INTER_AREA, encoding, 3840, 2160, 1280, 720), 0u);
+    }
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    // StereoImageProcessor owns node handles; nothing is advertised, so no master is needed
+    ros::init(argc, argv, "allocation_test", ros::init_options::AnonymousName | ros::init_options::NoRosout);
+    return RUN_ALL_TESTS();
+}
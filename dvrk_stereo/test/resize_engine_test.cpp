@@ -0,0 +1,116 @@
+#include "resize_engine.hpp"
+
+#include <gtest/gtest.h>
+#include <opencv2/imgproc.hpp>
+
+#include <string>
+
+// The 2:1 and 3:1 area paths against a plain per-pixel average, and against cv::resize.
+
+namespace {
+
+// Mean of each factor x factor block, rounded half up
+cv::Mat boxReference(const cv::Mat& cropped, int factor) {
+    cv::Mat reference(cropped.rows / factor, cropped.cols / factor, cropped.type());
+    const int channels = cropped.channels();
+    const int area = factor * factor;
+    for (int y = 0; y < reference.rows; ++y) {
+        for (int x = 0; x < reference.cols; ++x) {
+            for (int c = 0; c < channels; ++c) {
+                int total = 0;
+                for (int dy = 0; dy < factor; ++dy) {
+                    const uint8_t* row = cropped.ptr<uint8_t>(y * factor + dy);
+                    for (int dx = 0; dx < factor; ++dx) {
+                        total += row[(x * factor + dx) * channels + c];
+                    }
+                }
+                reference.ptr<uint8_t>(y)[x * channels + c] = static_cast<uint8_t>((total + area / 2) / area);
+            }
+        }
+    }
+    return reference;
+}
+
+cv::Mat randomImage(int width, int height, int channels) {
+    cv::Mat image(height, width, CV_8UC(channels));
+    cv::RNG rng(width * 31 + height * 7 + channels);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 256);
+    return image;
+}
+
+}
+
+TEST(BoxDownscale, MatchesReference) {
+    for (int factor = 2; factor <= 3; ++factor) {
+        for (int channels = 1; channels <= 4; ++channels) {
+            SCOPED_TRACE("factor " + std::to_string(factor) + ", channels " + std::to_string(channels));
+            // Odd output sizes, so no row is a multiple of a vector width
+            cv::Mat image = randomImage(37 * factor, 23 * factor, channels);
+            cv::Mat resized(23, 37, image.type());
+            dvrk_stereo::boxDownscale(image.data, image.step, resized.data, resized.step,
+                                      resized.cols, resized.rows, channels, factor);
+            EXPECT_EQ(cv::norm(resized, boxReference(image, factor), cv::NORM_INF), 0.0);
+        }
+    }
+}
+
+TEST(BoxDownscale, RoundsHalfUp) {
+    // Sums on either side of each rounding threshold, the largest at 255 everywhere
+    for (int factor = 2; factor <= 3; ++factor) {
+        const int area = factor * factor;
+        for (int total = 0; total <= area * 255; ++total) {
+            cv::Mat block(factor, factor, CV_8UC1, cv::Scalar(total / area));
+            for (int k = 0; k < total % area; ++k) {
+                ++block.at<uint8_t>(k / factor, k % factor);
+            }
+            uint8_t out = 0;
+            dvrk_stereo::boxDownscale(block.data, block.step, &out, 1, 1, 1, 1, factor);
+            ASSERT_EQ(static_cast<int>(out), (total + area / 2) / area) << "factor " << factor << ", sum " << total;
+        }
+    }
+}
+
+TEST(ResizeEngine, AreaCropMatchesReference) {
+    for (int threads = 1; threads <= 4; threads += 3) {
+        dvrk_stereo::ResizeEngine engine(cv::INTER_AREA);
+        engine.setThreads(threads);
+        for (int factor = 2; factor <= 3; ++factor) {
+            for (int channels = 1; channels <= 4; ++channels) {
+                SCOPED_TRACE("threads " + std::to_string(threads) + ", factor " + std::to_string(factor) +
+                             ", channels " + std::to_string(channels));
+                cv::Mat image = randomImage(160, 120, channels);
+                // Odd offsets into the image; four threads split the rows into uneven bands
+                cv::Size size(41, 3 + factor);
+                cv::Rect roi(7, 13, size.width * factor, size.height * factor);
+                cv::Mat resized;
+                engine.resize(image, roi, size, resized);
+                ASSERT_EQ(resized.size(), size);
+                ASSERT_EQ(resized.type(), image.type());
+                cv::Mat reference = boxReference(image(roi), factor);
+                EXPECT_EQ(cv::norm(resized, reference, cv::NORM_INF), 0.0);
+
+                // cv::resize rounds its fixed-point area weights differently, by one at most
+                cv::Mat area;
+                cv::resize(image(roi), area, size, 0.0, 0.0, cv::INTER_AREA);
+                EXPECT_LE(cv::norm(resized, area, cv::NORM_INF), 1.0);
+            }
+        }
+    }
+}
+
+TEST(ResizeEngine, OtherRatiosUseOpenCv) {
+    dvrk_stereo::ResizeEngine engine(cv::INTER_AREA);
+    engine.setThreads(4);
+    cv::Mat image = randomImage(160, 120, 3);
+    cv::Rect roi(5, 3, 150, 100);
+    cv::Size size(60, 40);
+    cv::Mat resized, reference;
+    engine.resize(image, roi, size, resized);
+    cv::resize(image(roi), reference, size, 0.0, 0.0, cv::INTER_AREA);
+    EXPECT_EQ(cv::norm(resized, reference, cv::NORM_INF), 0.0);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,80 @@
+#include "stereo_proc.hpp"
+
+#include <gtest/gtest.h>
+#include <sensor_msgs/image_encodings.h>
+
+#include <boost/make_shared.hpp>
+
+#include <string>
+
+// StereoImageProcessor on messages handed to it directly, without ROS transport.
+
+namespace {
+
+// Both bytes of each pixel follow the index of its chroma pair, so a luma sample
+// and the chroma pair it is interleaved with carry the same value
+sensor_msgs::ImagePtr makePairPattern(int width, int height, const std::string& encoding) {
+    sensor_msgs::ImagePtr image = boost::make_shared<sensor_msgs::Image>();
+    image->width = width;
+    image->height = height;
+    image->encoding = encoding;
+    image->step = width * 2;
+    image->data.resize(static_cast<size_t>(image->step) * height);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            uint8_t value = ((x / 2) % 2) ? 200 : 10;
+            image->data[y * image->step + x * 2] = value;
+            image->data[y * image->step + x * 2 + 1] = value;
+        }
+    }
+    return image;
+}
+
+}
+
+TEST(StereoImageProcessor, PackedYuvCropKeepsChromaPairs) {
+    for (const std::string encoding : {std::string(sensor_msgs::image_encodings::YUV422), std::string("yuv422_yuy2")}) {
+        SCOPED_TRACE(encoding);
+        dvrk_stereo::StereoImageProcessor processor(cv::INTER_NEAREST);
+        // The centred 5:4 crop of 1080 is 1350 wide and would start on column 285
+        processor.setDesiredSize(1350, 1080);
+        sensor_msgs::ImageConstPtr resized = processor.resizeImage(makePairPattern(1920, 1080, encoding));
+        ASSERT_TRUE(resized);
+        ASSERT_EQ(resized->encoding, encoding);
+        ASSERT_EQ(resized->width, 1350u);
+        ASSERT_EQ(resized->height, 1080u);
+
+        for (uint32_t y = 0; y < resized->height; y += 359) {
+            const uint8_t* row = resized->data.data() + y * resized->step;
+            for (uint32_t x = 0; x < resized->width; ++x) {
+                ASSERT_EQ(row[x * 2], row[x * 2 + 1]) << "row " << y << ", column " << x;
+            }
+        }
+    }
+}
+
+TEST(StereoImageProcessor, CropOffsetIsEven) {
+    dvrk_stereo::StereoImageProcessor processor;
+    processor.setDesiredSize(1280, 1024);
+    sensor_msgs::CameraInfoPtr info = boost::make_shared<sensor_msgs::CameraInfo>();
+    info->width = 1920;
+    info->height = 1080;
+    info->K[0] = info->K[4] = info->P[0] = info->P[5] = 1000.0;
+    info->K[2] = info->P[2] = 960.0;
+    info->K[5] = info->P[6] = 540.0;
+    info->K[8] = info->P[10] = 1.0;
+
+    sensor_msgs::CameraInfoConstPtr resized = processor.resizeInfo(info);
+    ASSERT_TRUE(resized);
+    // cx = (960 - crop_x) * scale, with the 1350 wide crop starting at column 284
+    double scale = 1280.0 / 1350.0;
+    EXPECT_NEAR(resized->K[0], 1000.0 * scale, 1e-9);
+    EXPECT_NEAR(resized->K[2], 960.0 * scale + static_cast<int>(-284 * scale), 1e-9);
+}
+
+int main(int argc, char** argv) {
+    testing::InitGoogleTest(&argc, argv);
+    // StereoImageProcessor owns node handles; nothing is advertised, so no master is needed
+    ros::init(argc, argv, "stereo_proc_test", ros::init_options::AnonymousName | ros::init_options::NoRosout);
+    return RUN_ALL_TESTS();
+}
@@ -54,6 +54,8 @@
 #include "rviz/default_plugin/interactive_markers/interactive_marker_control.h"
 #include "rviz/default_plugin/interactive_markers/interactive_marker.h"
 
+#include <rvinci_profiler/profiler.h>
+
 #include <OGRE/OgreSceneNode.h>
 #include <OGRE/OgreSceneManager.h>
 #include <OGRE/OgreRenderable.h>
@@ -372,6 +374,7 @@ bool InteractionCursorDisplay::generateKeyEvent(uint8_t key_event)
 
 void InteractionCursorDisplay::updateCallback(const interaction_cursor_msgs::InteractionCursorUpdateConstPtr &icu_cptr)
 {
+  RVINCI_PROFILE_SCOPE("InteractionCursorDisplay::updateCallback");
   if( !this->isEnabled() )
     return;
 
@@ -463,6 +466,7 @@ void InteractionCursorDisplay::clearOldSelections()
 
 void InteractionCursorDisplay::getIntersections(const Ogre::Sphere &sphere)
 {
+  RVINCI_PROFILE_SCOPE("InteractionCursorDisplay::getIntersections");
   Ogre::SphereSceneQuery* ssq = context_->getSceneManager()->createSphereQuery(sphere);
   MySceneQueryListener listener;
   listener.disp_ = this;
@@ -0,0 +1,82 @@
+#ifndef RVINCI_LATENCY_HISTOGRAM_H
+#define RVINCI_LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace rvinci
+{
+//! Lock-free histogram of latencies.
+/*! Buckets are logarithmic with BUCKETS_PER_OCTAVE per doubling, starting at
+ * one microsecond, so quantiles are accurate to about 9% from 1 us to 1 s.
+ * record() may be called from any thread without blocking. Readers see a
+ * consistent enough picture for statistics; reset() racing a record() may
+ * lose that one sample.
+ */
+class LatencyHistogram
+{
+public:
+  static const int BUCKETS_PER_OCTAVE = 8;
+  static const int BUCKETS = 20 * BUCKETS_PER_OCTAVE;
+
+  LatencyHistogram() { reset(); }
+
+  //!Adds one latency sample, in seconds.
+  void record(double seconds)
+  {
+    double us = seconds * 1e6;
+    int bucket = us > 1.0 ? (int)(std::log2(us) * BUCKETS_PER_OCTAVE) : 0;
+    if (bucket >= BUCKETS)
+      bucket = BUCKETS - 1;
+    buckets_[bucket].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+
+    unsigned long long ns = seconds > 0.0 ? (unsigned long long)(seconds * 1e9) : 0;
+    sum_ns_.fetch_add(ns, std::memory_order_relaxed);
+    unsigned long long prev = max_ns_.load(std::memory_order_relaxed);
+    while (ns > prev && !max_ns_.compare_exchange_weak(prev, ns, std::memory_order_relaxed))
+    {}
+  }
+
+  //!Latency (s) below which fraction q of the samples fall; 0 if there are none.
+  /*!Reports the upper edge of the bucket holding the quantile.*/
+  double quantile(double q) const
+  {
+    unsigned long total = count();
+    if (total == 0)
+      return 0.0;
+    unsigned long rank = (unsigned long)std::ceil(q * total);
+    unsigned long seen = 0;
+    for (int b = 0; b < BUCKETS; ++b)
+    {
+      seen += buckets_[b].load(std::memory_order_relaxed);
+      if (seen >= rank)
+        return std::min(std::exp2((double)(b + 1) / BUCKETS_PER_OCTAVE) * 1e-6, max());
+    }
+    return max();
+  }
+
+  unsigned long count() const { return count_.load(std::memory_order_relaxed); }
+  double mean() const { return count() ? sum_ns_.load(std::memory_order_relaxed) * 1e-9 / count() : 0.0; }
+  double max() const { return max_ns_.load(std::memory_order_relaxed) * 1e-9; }
+
+  void reset()
+  {
+    for (int b = 0; b < BUCKETS; ++b)
+      buckets_[b].store(0, std::memory_order_relaxed);
+    count_.store(0, std::memory_order_relaxed);
+    sum_ns_.store(0, std::memory_order_relaxed);
+    max_ns_.store(0, std::memory_order_relaxed);
+  }
+
+private:
+  std::atomic<unsigned long> buckets_[BUCKETS];
+  std::atomic<unsigned long> count_;
+  std::atomic<unsigned long long> sum_ns_;
+  std::atomic<unsigned long long> max_ns_;
+};
+
+} // namespace rvinci
+
+#endif
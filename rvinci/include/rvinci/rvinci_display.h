@@ -33,6 +33,7 @@
 #include "rviz/display.h"
 
 #include <string>
+#include <utility>
 #include <iostream>
 #include <cmath>
 #include <string>
@@ -47,6 +48,7 @@
 #include <QApplication>
 
 #include <QObject>
+#include <QTimer>
 #include <OGRE/OgreRenderTargetListener.h>
 #include <OGRE/OgrePrerequisites.h>
 #include <OgreVector3.h>
@@ -62,8 +64,10 @@
 #include <OGRE/OgreRenderWindow.h>
 
 #include <rviz/properties/bool_property.h>
+#include <rviz/properties/enum_property.h>
 #include <rviz/properties/status_property.h>
 #include <rviz/properties/float_property.h>
+#include <rviz/properties/int_property.h>
 #include <rviz/properties/string_property.h>
 #include <rviz/properties/tf_frame_property.h>
 #include <rviz/properties/vector_property.h>
@@ -75,6 +79,7 @@
 #include <rviz/display_context.h>
 #include <rviz/ogre_helpers/render_widget.h>
 #include <rviz/ogre_helpers/render_system.h>
+#include <rviz/ogre_helpers/movable_text.h>
 #include <rviz/frame_manager.h>
 #include <tf/transform_datatypes.h>
 
@@ -83,6 +88,7 @@
 #include <rvinci_input_msg/rvinci_input.h>
 
 #include <sensor_msgs/Image.h>
+#include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/Joy.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <std_msgs/Bool.h>
@@ -96,6 +102,19 @@
 
 #include <interactive_markers/interactive_marker_server.h>
 
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
+#include <boost/scoped_ptr.hpp>
+#include <atomic>
+#include <deque>
+#include <fstream>
+#include <vector>
+
+#include "rvinci/triple_buffer.h"
+#include "rvinci/latency_histogram.h"
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <rvinci_profiler/profiler.h>
+
 namespace Ogre
 {
 class SceneNode;
@@ -115,6 +134,86 @@ class RosTopicProperty;
 
 namespace rvinci
 {
+//! Camera image handed from the image thread to the render loop.
+/*! Holds a reference to the received message; the texture upload reads
+ * straight from its data, so frames are never copied on the CPU.
+ */
+struct VideoFrame
+{
+  sensor_msgs::ImageConstPtr image;
+  //!Per-eye arrival counter, used to skip uploading a frame twice.
+  unsigned long seq;
+  //!When the frame was handed to the render loop.
+  ros::Time received;
+
+  VideoFrame() : seq(0) {}
+};
+
+//! How a camera frame maps onto background texture planes.
+/*! Encodings the GPU can show directly use one plane and no program.
+ * Packed YUV, planar YUV and Bayer frames are uploaded raw and turned into
+ * RGB by a fragment program on the background material.
+ */
+struct VideoLayout
+{
+  int planes;
+  Ogre::PixelFormat format[2];
+  unsigned int width[2];
+  unsigned int height[2];
+  //!Byte offset of each plane in the image data and its row stride.
+  size_t offset[2];
+  size_t step[2];
+  std::string program;
+  //!Position of the red sample in a 2x2 Bayer tile.
+  float bayer_origin[2];
+
+  VideoLayout() : planes(0) {}
+
+  //!True if frames of both layouts can share textures and material.
+  bool matches(const VideoLayout& other) const
+  {
+    if (planes != other.planes || program != other.program ||
+        bayer_origin[0] != other.bayer_origin[0] || bayer_origin[1] != other.bayer_origin[1])
+      return false;
+    for (int p = 0; p < planes; ++p)
+    {
+      if (format[p] != other.format[p] || width[p] != other.width[p] || height[p] != other.height[p])
+        return false;
+    }
+    return true;
+  }
+};
+
+//! Times a video frame passed each stage on its way to the screen.
+/*! seq is 0 once the frame has been measured.*/
+struct VideoTiming
+{
+  unsigned long seq;
+  //!Capture time from the image header.
+  ros::Time stamp;
+  ros::Time received;
+  ros::Time uploaded;
+
+  VideoTiming() : seq(0) {}
+};
+
+//! Left and right frames matched by header stamp, presented together.
+struct StereoFramePair
+{
+  VideoFrame eye[2];
+};
+
+//! MTM sample carried by one /rvinci_input_update message.
+struct InputSample
+{
+  //!Header stamp of the rvinci_input message, its publish time.
+  ros::Time published;
+  //!When rvinci received the sample; motion-to-photon starts here.
+  ros::Time arrival;
+  //!Header stamp of the MTM pose, passed on in the cursor updates.
+  ros::Time stamp;
+};
+
 class rvinciDisplay: public rviz::Display, public Ogre::RenderTargetListener
 {
 //! RVinci display plugin for RViz.
@@ -173,19 +272,79 @@ protected Q_SLOTS:
   virtual void pubsubSetup();
   //!Toggle for DVRK Gravity Compensation state
   virtual void gravityCompensation();
+  //!Copies the stereo synchronization properties for use on the image thread.
+  virtual void updateSyncSettings();
+  //!Rebuilds the background texture rings after the ring size changed.
+  virtual void resetBackgroundTextures();
+  //!Renders both stereo windows; driven by the render timer, not by RViz's update tick.
+  virtual void renderStereo();
+  //!Applies the Render Rate property to the render timer.
+  virtual void updateRenderRate();
+  //!Applies the VSync property to both stereo windows.
+  virtual void updateVSync();
+  //!Rebuilds viewports and render targets for the selected stereo output.
+  virtual void layoutViewports();
+  //!Opens or closes the CSV file recording the video latency of every presented frame.
+  virtual void updateVideoLatencyTrace();
+  //!Shows or hides the video latency text in the stereo view.
+  virtual void updateVideoLatencyOverlay();
   // virtual void updateCursorVisibility();
   // virtual void updateCursorAxisVisibility();
 
 private:
   //!Creates viewports and cameras.
   void cameraSetup();
+  //!Creates per-eye render textures at window size for the row-interleaved composite.
+  void createEyeTargets(unsigned int width, unsigned int height);
+  void destroyEyeTargets();
+  //!Creates the scene holding the quads that compose the final image of the offscreen outputs.
+  void createCompositeScene();
+  //!Adds the video of eye i to the composite scene once its material exists.
+  void createCompositeBackground(int i);
+  //!Moves the eye cameras into window-sized overlay textures composited over the video in their place.
+  void createOverlayTargets();
+  //!Renders the overlays into the resolution_scale_ corner of their textures and stretches that over the eye.
+  /*!Changes viewport and texture coordinates only, the targets are not rebuilt.*/
+  void applyResolutionScale();
+  //!Steps the overlay scale toward the target frame time.
+  /*!render_time excludes buffer swaps, which wait for the vertical blank with VSync on.*/
+  void updateResolutionScale(double render_time);
   //!Called when input message received.
   /*!Contains primary input logic. Records input position and calculates change in
    * input position. Updates cursor position then sends data to camera control and cursor publisher.
    */
   void inputCallback(const rvinci_input_msg::rvinci_input::ConstPtr& r_input);
-  void leftCallback(const sensor_msgs::ImageConstPtr& img);
-  void rightCallback(const sensor_msgs::ImageConstPtr& img);
+  //!Called on the image spinner thread; stores the frame in a free slot and publishes it.
+  void imageCallback(const sensor_msgs::ImageConstPtr& img, int i);
+  //!Pairs queued left/right frames whose stamps are within the sync slop.
+  void matchStereoFrames();
+  //!Stores a reference to an image message and its arrival time in a frame slot.
+  void storeFrame(const sensor_msgs::ImageConstPtr& img, const ros::Time& received, int i, VideoFrame& frame);
+  //!Uploads a frame of eye i to its background texture, creating it if needed.
+  /*!fresh is true if the frame was just taken from its triple buffer; otherwise it is only
+   * uploaded to refill textures that were rebuilt. Returns true if a new frame reached the texture.*/
+  bool uploadFrame(int i, const VideoFrame& frame, bool fresh);
+  //!Drops the frames held by the triple buffers, which are older than the ones shown.
+  /*!Called from the render loop when stereo sync is switched on or off.*/
+  void discardVideoFrames();
+  //!Reports stereo synchronization counters as a status entry.
+  void updateSyncStatus();
+  //!Reports the share of render ticks that skipped the texture upload.
+  void updateUploadStatus();
+  //!Reports the interval and duration of stereo frames as a status entry.
+  void updateFramePacingStatus();
+  //!Publishes the motion-to-photon quantiles on /diagnostics and in the status, once per second.
+  void updateLatencyStatus();
+  //!Publishes the frame time and upload time quantiles on /diagnostics, once per second.
+  void updateTimingDiagnostics();
+  //!Records the stage latencies of the frames uploaded since the last presented frame.
+  void recordVideoLatency(const ros::Time& presented);
+  //!Publishes the per-eye video latency on /diagnostics, in the status and on the overlay, once per second.
+  void updateVideoLatencyStatus();
+  //!Releases the background texture ring of eye i; it is rebuilt by the next upload.
+  void destroyBackgroundTextures(int i);
+  //!Binds the current texture planes and conversion program of eye i to its material.
+  void configureBackgroundMaterial(int i);
   void clutchCallback(const sensor_msgs::Joy::ConstPtr& msg);
   void teleopCallback(const std_msgs::Bool::ConstPtr& msg);
   void cameraCallback(const sensor_msgs::Joy::ConstPtr& msg);
@@ -198,7 +357,7 @@ private:
   void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg);
 
   //!Publishes cursor position and grip state to interaction cursor 3D display type.
-  void publishCursorUpdate(int grab[2]);
+  void publishCursorUpdate(int grab[2], const ros::Time& stamp);
   void updateCursorVisibility(const interaction_cursor_msgs::InteractionCursorUpdate& msg);
   //!Logic for grip state, used in interaction cursor 3D display type.
   int getaGrip(bool, int);
@@ -213,11 +372,6 @@ private:
   visualization_msgs::Marker makeLineMarker(geometry_msgs::Point p1, geometry_msgs::Point p2, int id);
   visualization_msgs::Marker makeTextMessage(geometry_msgs::Pose p, std::string msg, int id);
   visualization_msgs::Marker deleteAllMarkers();
-<<<<<<< HEAD
-  // void rvinciDisplay::saveMeasurementData(double distance, const std::string &mode);
-  int uniqueLineMarkerID();
-=======
->>>>>>> VANESSA
 
   //measurement
   void toggleDualHandMode();
@@ -272,15 +426,117 @@ private:
   Ogre::SceneNode *target_node_;
   Ogre::SceneNode *image_node_;
 
-  unsigned char* buffer_[2];
-  Ogre::Image* backgroundImage_[2];
+  TripleBuffer<VideoFrame> video_frames_[2];
+  TripleBuffer<StereoFramePair> video_pairs_;
+  //!Frames waiting for a partner with their arrival times; only touched on the image thread.
+  std::deque<std::pair<sensor_msgs::ImageConstPtr, ros::Time> > sync_queue_[2];
+  std::atomic<bool> sync_enabled_;
+  //!Sync mode the render loop last uploaded video in.
+  bool presented_sync_;
+  std::atomic<double> sync_slop_;
+  std::atomic<int> sync_queue_size_;
+  std::atomic<unsigned long> sync_matched_;
+  std::atomic<unsigned long> sync_mismatched_;
+  std::atomic<unsigned long> sync_overflow_;
+  std::atomic<unsigned long> sync_superseded_;
+  ros::WallTime sync_status_time_;
+  unsigned long frame_seq_[2];
+  unsigned long uploaded_seq_[2];
+  unsigned long upload_count_[2];
+  unsigned long upload_skip_count_[2];
+  ros::WallTime upload_status_time_;
+
+  QTimer* render_timer_;
+  ros::WallTime last_render_time_;
+  double render_interval_sum_;
+  double render_interval_max_;
+  double render_time_sum_;
+  double render_time_max_;
+  unsigned long render_count_;
+  unsigned long render_tick_count_;
+  unsigned long present_skip_count_;
+  ros::WallTime render_status_time_;
+  //!Duration of presented frames and of the uploads of ticks that received video.
+  rvinci::LatencyHistogram frame_time_;
+  rvinci::LatencyHistogram upload_time_;
+  ros::WallTime timing_status_time_;
+
+  //!Motion-to-photon: arrival and header stamp of the newest MTM sample.
+  ros::Time mtm_stamp_;
+  ros::Time mtm_sample_stamp_;
+  //!MTM sample carried by each recent rvmsg_; rvmsg_ keeps its publish time.
+  std::deque<InputSample> input_stamps_;
+  static constexpr size_t MAX_INPUT_STAMPS = 32;
+  //!Newest input shown by the next presented frame, and the last one already recorded.
+  ros::Time pending_input_stamp_;
+  ros::Time presented_input_stamp_;
+  rvinci::LatencyHistogram motion_to_photon_;
+  ros::WallTime latency_status_time_;
+
+  //!Glass-to-glass video latency, split into the stages a frame passes through.
+  enum VideoStage {STAGE_TRANSPORT, STAGE_QUEUE, STAGE_PRESENT, STAGE_TOTAL, VIDEO_STAGES};
+  VideoTiming video_timing_[2];
+  rvinci::LatencyHistogram video_latency_[2][VIDEO_STAGES];
+  ros::WallTime video_latency_status_time_;
+  std::ofstream video_trace_;
+  //!One latency caption per eye, visible only in that eye's views (see updateVideoLatencyOverlay).
+  Ogre::SceneNode* video_latency_node_[2];
+  rviz::MovableText* video_latency_text_[2];
+
+  enum PresentMode {PRESENT_INDEPENDENT, PRESENT_PAIRED};
+  //!Adaptive present still redraws at this interval (s), other displays may have changed the scene.
+  static constexpr double MAX_PRESENT_INTERVAL = 0.1;
+  //!Resolution controller: steps the overlay scale by RESOLUTION_STEP at most every RESOLUTION_INTERVAL (s),
+  //!down above the target frame time and up below RESOLUTION_HEADROOM of it.
+  static constexpr float RESOLUTION_STEP = 0.125f;
+  static constexpr double RESOLUTION_INTERVAL = 0.5;
+  static constexpr double RESOLUTION_HEADROOM = 0.75;
+  float resolution_scale_;
+  double frame_time_avg_;
+  //!Time spent in swapBuffers() during the current frame.
+  double swap_time_;
+  ros::WallTime resolution_time_;
+  //!Scale applied to the overlay targets, 0 while rendering at full resolution, and the window sizes they were built for.
+  float layout_scale_;
+  unsigned int layout_size_[2][2];
+  //!Set by input that moves the cursors; cleared when a frame is presented.
+  bool scene_dirty_;
+  ros::WallTime last_present_time_;
+  Ogre::Vector3 presented_camera_pos_;
+  Ogre::Quaternion presented_camera_ori_;
   Ogre::MaterialPtr material_[2];
-  Ogre::TexturePtr texture_[2];
+  //!Ring of streaming textures per eye; frame N+1 is written while frame N is drawn.
+  /*!Entry k*planes+p holds plane p of ring slot k.*/
+  std::vector<Ogre::TexturePtr> texture_[2];
+  unsigned int texture_index_[2];
+  VideoLayout video_layout_[2];
+  //!Set when the video status entry of an eye needs refreshing.
+  bool video_error_[2];
   Ogre::Rectangle2D* rect_[2];
 
   Ogre::Viewport *viewport_[2];
   Ogre::RenderWindow *window_;
   Ogre::RenderWindow *window_R_;
+  Ogre::ColourValue bg_color_;
+
+  enum StereoOutput {OUTPUT_DUAL_WINDOW, OUTPUT_SIDE_BY_SIDE, OUTPUT_TOP_BOTTOM,
+                     OUTPUT_ROW_INTERLEAVED, OUTPUT_QUAD_BUFFER};
+  //!Output mode actually in use; quad buffer falls back to side-by-side if unsupported.
+  int stereo_output_;
+  //!Targets updated each frame, in order, and windows swapped together in paired mode.
+  std::vector<Ogre::RenderTarget*> stereo_targets_;
+  std::vector<Ogre::RenderWindow*> stereo_windows_;
+  //!Eye images for outputs composed by a fragment program, drawn by a quad in a scene of its own.
+  Ogre::TexturePtr eye_texture_[2];
+  Ogre::SceneManager* composite_scene_;
+  Ogre::Camera* composite_camera_;
+  Ogre::Rectangle2D* composite_rect_;
+  Ogre::MaterialPtr composite_material_;
+  //!Scaled 3D overlay per eye and the quads compositing it over the full resolution video.
+  Ogre::TexturePtr overlay_texture_[2];
+  Ogre::MaterialPtr overlay_material_[2];
+  Ogre::Rectangle2D* overlay_rect_[2];
+  Ogre::Rectangle2D* composite_bg_rect_[2];
 
   Ogre::Vector3 initial_cvect_;
   Ogre::Vector3 camera_ipd_;
@@ -292,6 +548,10 @@ private:
   Ogre::Vector3 input_change_[2];
 
   ros::NodeHandle nh_;
+  //!Image subscriptions run on their own queue so they never wait for the render loop.
+  ros::NodeHandle image_nh_;
+  ros::CallbackQueue image_queue_;
+  boost::scoped_ptr<ros::AsyncSpinner> image_spinner_;
   ros::Subscriber subscriber_input_;
   ros::Subscriber subscriber_lcam_;
   ros::Subscriber subscriber_rcam_;
@@ -316,11 +576,14 @@ private:
   ros::Publisher publisher_lhcursor_display_;
   ros::Publisher pub_robot_state_[2];
   ros::Publisher publisher_rvinci_;
+  ros::Publisher publisher_diagnostics_;
   ros::Publisher publisher_markers;
   ros::Publisher publisher_lwrench_;
   ros::Publisher publisher_rwrench_;
   ros::Publisher publisher_lgravity_;
   ros::Publisher publisher_rgravity_;
+  //!Dumps the RVINCI_PROFILE_SCOPE timings of the RViz process on rvinci/dump_trace.
+  rvinci_profiler::TraceService trace_service_;
 
   ros::Time clutch_press_start_time_;
 
@@ -334,6 +597,21 @@ private:
   rviz::BoolProperty *prop_cam_reset_;
   rviz::BoolProperty *property_show_cursor_;
   rviz::BoolProperty *property_show_cursor_axis_;
+  rviz::BoolProperty *prop_sync_stereo_;
+  rviz::FloatProperty *prop_sync_slop_;
+  rviz::IntProperty *prop_sync_queue_size_;
+  rviz::IntProperty *prop_upload_ring_size_;
+  rviz::FloatProperty *prop_render_rate_;
+  rviz::EnumProperty *prop_present_mode_;
+  rviz::BoolProperty *prop_vsync_;
+  rviz::BoolProperty *prop_adaptive_present_;
+  rviz::EnumProperty *prop_stereo_output_;
+  rviz::BoolProperty *prop_swap_eyes_;
+  rviz::BoolProperty *prop_dynamic_resolution_;
+  rviz::FloatProperty *prop_target_frame_time_;
+  rviz::FloatProperty *prop_min_resolution_scale_;
+  rviz::StringProperty *prop_video_latency_trace_;
+  rviz::BoolProperty *prop_video_latency_overlay_;
 
   rviz::RenderWidget *render_widget_;
   rviz::RenderWidget *render_widget_R_;
@@ -355,6 +633,10 @@ private:
   double cy_;
   double img_height_;
   double img_width_;
+  //!Incremented once per stereo frame; cameraUpdate() runs once per value.
+  unsigned long frame_epoch_;
+  unsigned long camera_epoch_;
+  bool projection_dirty_;
 };
 
 } // namespace rvinci
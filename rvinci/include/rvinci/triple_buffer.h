@@ -0,0 +1,65 @@
+#ifndef RVINCI_TRIPLE_BUFFER_H
+#define RVINCI_TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace rvinci
+{
+//! Lock-free single-producer/single-consumer triple buffer.
+/*! The producer fills writeSlot() and calls publish(), which swaps the slot
+ * with the shared middle slot through one atomic exchange. The consumer calls
+ * update() to take the newest published slot, if any, and then reads it through
+ * readSlot(). Neither side ever blocks and the consumer never sees a slot while
+ * it is being written. Slots are reused, so a T holding a std::vector keeps its
+ * capacity between frames.
+ */
+template <typename T>
+class TripleBuffer
+{
+public:
+  TripleBuffer()
+    : back_(0)
+    , middle_(1)
+    , front_(2)
+  {}
+
+  //!Slot owned by the producer until the next publish().
+  T& writeSlot() { return slots_[back_]; }
+
+  //!Hands the write slot to the consumer.
+  /*!Returns true if the previously published slot was never taken by
+   * the consumer, i.e. a frame was dropped.
+   */
+  bool publish()
+  {
+    unsigned int prev = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel);
+    back_ = prev & INDEX;
+    return (prev & FRESH) != 0;
+  }
+
+  //!Takes the newest published slot. Returns false if nothing new was published.
+  bool update()
+  {
+    if (!(middle_.load(std::memory_order_acquire) & FRESH))
+      return false;
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+
+  //!Slot owned by the consumer until the next successful update().
+  T& readSlot() { return slots_[front_]; }
+  const T& readSlot() const { return slots_[front_]; }
+
+private:
+  static const unsigned int INDEX = 0x3;
+  static const unsigned int FRESH = 0x4;
+
+  T slots_[3];
+  unsigned int back_;
+  std::atomic<unsigned int> middle_;
+  unsigned int front_;
+};
+
+} // namespace rvinci
+
+#endif
@@ -0,0 +1,38 @@
+#version 120
+
+// Bilinear demosaicing of an 8 bit Bayer mosaic uploaded as a luminance
+// texture. bayer_origin is the position of the red sample in a 2x2 tile.
+
+uniform sampler2D mosaic;
+uniform vec4 tex_size;
+uniform vec2 bayer_origin;
+
+float sampleAt(vec2 pixel)
+{
+  return texture2D(mosaic, pixel / tex_size.xy).r;
+}
+
+void main()
+{
+  vec2 pixel = floor(gl_TexCoord[0].xy * tex_size.xy);
+  vec2 center = pixel + 0.5;
+  vec2 parity = mod(pixel + bayer_origin, 2.0);
+
+  float c = sampleAt(center);
+  float horiz = 0.5 * (sampleAt(center + vec2(1.0, 0.0)) + sampleAt(center - vec2(1.0, 0.0)));
+  float vert = 0.5 * (sampleAt(center + vec2(0.0, 1.0)) + sampleAt(center - vec2(0.0, 1.0)));
+  float cross = 0.5 * (horiz + vert);
+  float diag = 0.25 * (sampleAt(center + vec2(1.0, 1.0)) + sampleAt(center - vec2(1.0, 1.0)) +
+                       sampleAt(center + vec2(1.0, -1.0)) + sampleAt(center - vec2(1.0, -1.0)));
+
+  vec3 rgb;
+  if (parity.x < 0.5 && parity.y < 0.5)
+    rgb = vec3(c, cross, diag);   // red site
+  else if (parity.x > 0.5 && parity.y > 0.5)
+    rgb = vec3(diag, cross, c);   // blue site
+  else if (parity.y < 0.5)
+    rgb = vec3(horiz, c, vert);   // green site on a red row
+  else
+    rgb = vec3(vert, c, horiz);   // green site on a blue row
+  gl_FragColor = vec4(rgb, 1.0);
+}
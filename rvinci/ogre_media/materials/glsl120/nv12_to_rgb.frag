@@ -0,0 +1,30 @@
+#version 120
+
+// Planar 4:2:0 video: a full resolution luminance texture and a half
+// resolution luminance/alpha texture holding the interleaved chroma.
+
+uniform sampler2D y_plane;
+uniform sampler2D uv_plane;
+
+vec3 yuvToRgb(float y, float u, float v)
+{
+  // BT.601, limited range
+  y = 1.164 * (y - 0.0625);
+  u -= 0.5;
+  v -= 0.5;
+  return clamp(vec3(y + 1.596 * v,
+                    y - 0.392 * u - 0.813 * v,
+                    y + 2.017 * u), 0.0, 1.0);
+}
+
+void main()
+{
+  float y = texture2D(y_plane, gl_TexCoord[0].xy).r;
+  vec4 c = texture2D(uv_plane, gl_TexCoord[0].xy);
+#ifdef NV21
+  vec3 rgb = yuvToRgb(y, c.a, c.r);
+#else
+  vec3 rgb = yuvToRgb(y, c.r, c.a);
+#endif
+  gl_FragColor = vec4(rgb, 1.0);
+}
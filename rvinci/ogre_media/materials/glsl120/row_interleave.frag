@@ -0,0 +1,14 @@
+#version 120
+
+// Row-interleaved stereo for passive (line-polarized) monitors: even window
+// rows, counted from the bottom, show the first eye and odd rows the second.
+
+uniform sampler2D first_eye;
+uniform sampler2D second_eye;
+
+void main()
+{
+  bool odd = mod(floor(gl_FragCoord.y), 2.0) >= 1.0;
+  gl_FragColor = odd ? texture2D(second_eye, gl_TexCoord[0].xy)
+                     : texture2D(first_eye, gl_TexCoord[0].xy);
+}
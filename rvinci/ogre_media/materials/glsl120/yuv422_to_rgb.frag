@@ -0,0 +1,32 @@
+#version 120
+
+// Packed 4:2:2 video uploaded as an RGBA texture of half the image width,
+// each texel holding two pixels: U Y0 V Y1 (UYVY) or Y0 U Y1 V (YUYV).
+
+uniform sampler2D video;
+uniform vec4 tex_size;
+
+vec3 yuvToRgb(float y, float u, float v)
+{
+  // BT.601, limited range
+  y = 1.164 * (y - 0.0625);
+  u -= 0.5;
+  v -= 0.5;
+  return clamp(vec3(y + 1.596 * v,
+                    y - 0.392 * u - 0.813 * v,
+                    y + 2.017 * u), 0.0, 1.0);
+}
+
+void main()
+{
+  vec4 t = texture2D(video, gl_TexCoord[0].xy);
+  bool second = fract(gl_TexCoord[0].x * tex_size.x) >= 0.5;
+#ifdef YUYV
+  float y = second ? t.b : t.r;
+  vec3 rgb = yuvToRgb(y, t.g, t.a);
+#else
+  float y = second ? t.a : t.g;
+  vec3 rgb = yuvToRgb(y, t.r, t.b);
+#endif
+  gl_FragColor = vec4(rgb, 1.0);
+}
@@ -0,0 +1,362 @@
+/*
+ * Replay benchmark for the rvinci console pipeline.
+ *
+ * Feeds synthetic stereo video, camera_info, MTM poses and pedal events to a
+ * running rvinciDisplay at fixed rates, without a da Vinci. Recorded traffic
+ * can be played with rosbag instead of the synthetic streams. Input-to-cursor
+ * latency is measured here for synthetic MTM poses: rvinci stamps each cursor
+ * update with the header stamp of the pose it shows, which this node set when
+ * publishing it. Frame time, upload time, video latency and
+ * motion-to-photon come from the diagnostics rvinci publishes. See
+ * launch/replay_benchmark.launch for a headless run through Mesa.
+ */
+
+#include <ros/ros.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <interaction_cursor_msgs/InteractionCursorUpdate.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <sensor_msgs/Image.h>
+#include <sensor_msgs/Joy.h>
+#include <sensor_msgs/image_encodings.h>
+#include <std_msgs/Bool.h>
+
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
+
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "rvinci/latency_histogram.h"
+
+namespace rvinci
+{
+enum Hand {HAND_LEFT, HAND_RIGHT};
+
+//! Publishes the console's inputs at fixed rates and reports the measured distributions.
+class ReplayBenchmark
+{
+public:
+  ReplayBenchmark();
+
+  //!Advertises, subscribes and starts the timers; false if the parameters are unusable.
+  bool init();
+
+private:
+  //!Min, mean and max of one rvinci diagnostic value over the measured windows.
+  struct Summary
+  {
+    double min, max, sum;
+    unsigned long count;
+    Summary() : min(0.0), max(0.0), sum(0.0), count(0) {}
+    void add(double v)
+    {
+      min = count ? std::min(min, v) : v;
+      max = count ? std::max(max, v) : v;
+      sum += v;
+      ++count;
+    }
+  };
+
+  void videoTimer(const ros::WallTimerEvent&);
+  void mtmTimer(const ros::WallTimerEvent&);
+  void pedalTimer(const ros::WallTimerEvent&);
+  void finish(const ros::WallTimerEvent&);
+  void cursorCallback(const interaction_cursor_msgs::InteractionCursorUpdate::ConstPtr& msg, int i);
+  void diagnosticsCallback(const diagnostic_msgs::DiagnosticArray::ConstPtr& msg);
+  bool measuring() const { return ros::WallTime::now() >= measure_start_; }
+  void report();
+
+  ros::NodeHandle nh_;
+  ros::NodeHandle private_nh_;
+
+  int width_, height_;
+  std::string encoding_;
+  std::string camera_frame_;
+  double duration_, warmup_;
+  double video_rate_, mtm_rate_, pedal_period_;
+
+  sensor_msgs::Image frame_template_;
+  sensor_msgs::CameraInfo camera_info_;
+  unsigned long video_seq_;
+  unsigned long mtm_seq_;
+
+  ros::Publisher image_pub_[2];
+  ros::Publisher info_pub_;
+  ros::Publisher mtm_pub_[2];
+  ros::Publisher camera_pedal_pub_;
+  ros::Publisher clutch_pub_;
+  ros::Publisher teleop_pub_;
+  ros::Subscriber cursor_sub_[2];
+  ros::Subscriber diagnostics_sub_;
+  ros::WallTimer video_timer_, mtm_timer_, pedal_timer_, finish_timer_;
+
+  ros::WallTime start_, measure_start_;
+  //!Recorded poses carry the stamps of the recording, so only synthetic ones are timed.
+  bool synthetic_mtm_;
+  ros::Time last_cursor_stamp_[2];
+  LatencyHistogram input_to_cursor_;
+  unsigned long video_frames_sent_;
+  //!Keyed by "<status name>/<value key>".
+  std::map<std::string, Summary> diagnostics_;
+  std::string output_;
+};
+
+ReplayBenchmark::ReplayBenchmark()
+  : private_nh_("~")
+  , video_seq_(0)
+  , mtm_seq_(0)
+  , synthetic_mtm_(true)
+  , video_frames_sent_(0)
+{
+}
+
+bool ReplayBenchmark::init()
+{
+  std::string camera;
+  bool synthetic_video;
+  private_nh_.param("camera", camera, std::string("/jhu_daVinci/stereo_processed"));
+  private_nh_.param("camera_frame", camera_frame_, std::string("benchmark_camera"));
+  private_nh_.param("width", width_, 1280);
+  private_nh_.param("height", height_, 1024);
+  private_nh_.param("encoding", encoding_, std::string(sensor_msgs::image_encodings::RGB8));
+  private_nh_.param("video_rate", video_rate_, 30.0);
+  private_nh_.param("mtm_rate", mtm_rate_, 100.0);
+  private_nh_.param("pedal_period", pedal_period_, 0.0);
+  private_nh_.param("duration", duration_, 30.0);
+  private_nh_.param("warmup", warmup_, 3.0);
+  private_nh_.param("synthetic_video", synthetic_video, true);
+  private_nh_.param("synthetic_mtm", synthetic_mtm_, true);
+  private_nh_.param("output", output_, std::string(""));
+
+  int bits = 0;
+  try
+  {
+    bits = sensor_msgs::image_encodings::bitDepth(encoding_) *
+           sensor_msgs::image_encodings::numChannels(encoding_);
+  }
+  catch (std::runtime_error& e)
+  {
+    ROS_ERROR_STREAM("replay_benchmark: " << e.what());
+    return false;
+  }
+  if (width_ <= 0 || height_ <= 0 || video_rate_ <= 0.0 || mtm_rate_ <= 0.0 || duration_ <= 0.0)
+  {
+    ROS_ERROR("replay_benchmark: sizes, rates and duration must be positive");
+    return false;
+  }
+
+  // Gradient test card; the content does not change the upload cost, only its size does.
+  frame_template_.header.frame_id = camera_frame_;
+  frame_template_.width = width_;
+  frame_template_.height = height_;
+  frame_template_.encoding = encoding_;
+  frame_template_.step = width_ * bits / 8;
+  frame_template_.data.resize((size_t)frame_template_.step * height_);
+  for (int y = 0; y < height_; ++y)
+  {
+    for (size_t x = 0; x < frame_template_.step; ++x)
+      frame_template_.data[y * frame_template_.step + x] = (unsigned char)((x + y) & 0xFF);
+  }
+
+  // Pinhole camera with a 90 degree horizontal field of view
+  camera_info_.header.frame_id = camera_frame_;
+  camera_info_.width = width_;
+  camera_info_.height = height_;
+  double f = width_ / 2.0;
+  camera_info_.K[0] = camera_info_.P[0] = f;
+  camera_info_.K[4] = camera_info_.P[5] = f;
+  camera_info_.K[2] = camera_info_.P[2] = width_ / 2.0;
+  camera_info_.K[5] = camera_info_.P[6] = height_ / 2.0;
+  camera_info_.K[8] = camera_info_.P[10] = 1.0;
+
+  const char* const side[2] = {"left", "right"};
+  const char* const mtm[2] = {"/MTML/measured_cp", "/MTMR/measured_cp"};
+  for (int i = 0; i < 2; ++i)
+  {
+    if (synthetic_video)
+      image_pub_[i] = nh_.advertise<sensor_msgs::Image>(camera + "/" + side[i] + "/image", 1);
+    if (synthetic_mtm_)
+      mtm_pub_[i] = nh_.advertise<geometry_msgs::PoseStamped>(mtm[i], 10);
+    cursor_sub_[i] = nh_.subscribe<interaction_cursor_msgs::InteractionCursorUpdate>(
+        std::string("rvinci_cursor_") + side[i] + "/update", 10, boost::bind(&ReplayBenchmark::cursorCallback, this, _1, i),
+        ros::VoidConstPtr(), ros::TransportHints().tcpNoDelay());
+  }
+  if (synthetic_video)
+    info_pub_ = nh_.advertise<sensor_msgs::CameraInfo>(camera + "/right/camera_info", 1);
+  camera_pedal_pub_ = nh_.advertise<sensor_msgs::Joy>("/footpedals/camera", 10);
+  clutch_pub_ = nh_.advertise<sensor_msgs::Joy>("/footpedals/clutch", 10, true);
+  teleop_pub_ = nh_.advertise<std_msgs::Bool>("/console/teleop/enabled", 1, true);
+  diagnostics_sub_ = nh_.subscribe<diagnostic_msgs::DiagnosticArray>("/diagnostics", 50,
+                                                                     &ReplayBenchmark::diagnosticsCallback, this);
+
+  // MTM measurement mode with the clutch released, as on a console at rest
+  std_msgs::Bool teleop;
+  teleop.data = false;
+  teleop_pub_.publish(teleop);
+  sensor_msgs::Joy clutch;
+  clutch.buttons.push_back(0);
+  clutch_pub_.publish(clutch);
+
+  start_ = ros::WallTime::now();
+  measure_start_ = start_ + ros::WallDuration(warmup_);
+  if (synthetic_video)
+    video_timer_ = nh_.createWallTimer(ros::WallDuration(1.0 / video_rate_), &ReplayBenchmark::videoTimer, this);
+  if (synthetic_mtm_)
+    mtm_timer_ = nh_.createWallTimer(ros::WallDuration(1.0 / mtm_rate_), &ReplayBenchmark::mtmTimer, this);
+  if (pedal_period_ > 0.0)
+    pedal_timer_ = nh_.createWallTimer(ros::WallDuration(pedal_period_), &ReplayBenchmark::pedalTimer, this);
+  finish_timer_ = nh_.createWallTimer(ros::WallDuration(warmup_ + duration_), &ReplayBenchmark::finish, this, true);
+
+  ROS_INFO_STREAM("replay_benchmark: " << (synthetic_video ? "" : "no ") << "synthetic " << width_ << "x" << height_
+                  << " " << encoding_ << " video at " << video_rate_ << " Hz, " << (synthetic_mtm_ ? "" : "no ")
+                  << "synthetic MTMs at " << mtm_rate_ << " Hz, measuring " << duration_ << " s after "
+                  << warmup_ << " s warmup");
+  return true;
+}
+
+void ReplayBenchmark::videoTimer(const ros::WallTimerEvent&)
+{
+  // Same stamp on both eyes, so synchronized stereo pairs them
+  ros::Time stamp = ros::Time::now();
+  for (int i = 0; i < 2; ++i)
+  {
+    sensor_msgs::ImagePtr frame = boost::make_shared<sensor_msgs::Image>(frame_template_);
+    frame->header.stamp = stamp;
+    frame->header.seq = video_seq_;
+    image_pub_[i].publish(frame);
+  }
+  camera_info_.header.stamp = stamp;
+  info_pub_.publish(camera_info_);
+  ++video_seq_;
+  if (measuring())
+    ++video_frames_sent_;
+}
+
+void ReplayBenchmark::mtmTimer(const ros::WallTimerEvent&)
+{
+  // Slow circles a few centimetres wide, in opposite directions for both hands
+  // Both hands share the stamp of this tick; it comes back in the cursor updates showing them.
+  double t = (ros::WallTime::now() - start_).toSec();
+  ros::Time stamp = ros::Time::now();
+  for (int i = 0; i < 2; ++i)
+  {
+    double phase = 2.0 * M_PI * 0.5 * t * (i == HAND_LEFT ? 1.0 : -1.0);
+    geometry_msgs::PoseStamped pose;
+    pose.header.stamp = stamp;
+    pose.header.seq = mtm_seq_;
+    pose.header.frame_id = "benchmark_mtm";
+    pose.pose.position.x = (i == HAND_LEFT ? -0.1 : 0.1) + 0.02 * std::cos(phase);
+    pose.pose.position.y = 0.02 * std::sin(phase);
+    pose.pose.position.z = 0.0;
+    pose.pose.orientation.w = 1.0;
+    mtm_pub_[i].publish(pose);
+  }
+  ++mtm_seq_;
+}
+
+void ReplayBenchmark::pedalTimer(const ros::WallTimerEvent&)
+{
+  // Quick tap: steps the measurement tool, which redraws its markers
+  sensor_msgs::Joy pedal;
+  pedal.header.stamp = ros::Time::now();
+  pedal.buttons.push_back(2);
+  camera_pedal_pub_.publish(pedal);
+}
+
+void ReplayBenchmark::cursorCallback(const interaction_cursor_msgs::InteractionCursorUpdate::ConstPtr& msg, int i)
+{
+  ros::Time now = ros::Time::now();
+  const ros::Time& stamp = msg->pose.header.stamp;
+  // rvinci republishes an unchanged sample on every update; only its first cursor counts.
+  if (stamp.isZero() || stamp <= last_cursor_stamp_[i])
+    return;
+  last_cursor_stamp_[i] = stamp;
+  if (!measuring() || !synthetic_mtm_)
+    return;
+
+  // The stamp is the one mtmTimer() gave the sample this cursor shows.
+  input_to_cursor_.record((now - stamp).toSec());
+}
+
+void ReplayBenchmark::diagnosticsCallback(const diagnostic_msgs::DiagnosticArray::ConstPtr& msg)
+{
+  if (!measuring())
+    return;
+  for (size_t s = 0; s < msg->status.size(); ++s)
+  {
+    const diagnostic_msgs::DiagnosticStatus& status = msg->status[s];
+    if (status.hardware_id != "rvinci")
+      continue;
+    for (size_t v = 0; v < status.values.size(); ++v)
+    {
+      std::stringstream ss(status.values[v].value);
+      double value;
+      if (ss >> value)
+        diagnostics_[status.name + "/" + status.values[v].key].add(value);
+    }
+  }
+}
+
+void ReplayBenchmark::finish(const ros::WallTimerEvent&)
+{
+  report();
+  ros::shutdown();
+}
+
+void ReplayBenchmark::report()
+{
+  const double ms = 1000.0;
+  std::stringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "metric,min,mean,max\n";
+  ss << "video frames sent per eye,," << video_frames_sent_ << ",\n";
+  if (input_to_cursor_.count())
+  {
+    const double quantiles[] = {0.5, 0.9, 0.99};
+    const char* const name[] = {"p50", "p90", "p99"};
+    for (int q = 0; q < 3; ++q)
+      ss << "input to cursor " << name[q] << " (ms),," << input_to_cursor_.quantile(quantiles[q]) * ms << ",\n";
+    ss << "input to cursor mean (ms),," << input_to_cursor_.mean() * ms << ",\n";
+    ss << "input to cursor max (ms),," << input_to_cursor_.max() * ms << ",\n";
+    ss << "input to cursor samples,," << input_to_cursor_.count() << ",\n";
+  }
+  else if (!synthetic_mtm_)
+    ss << "# input to cursor is measured with synthetic MTM poses only\n";
+  // rvinci reports once a second; these spread over the per-second windows.
+  for (std::map<std::string, Summary>::const_iterator it = diagnostics_.begin(); it != diagnostics_.end(); ++it)
+  {
+    const Summary& summary = it->second;
+    ss << it->first << "," << summary.min << "," << summary.sum / summary.count << "," << summary.max << "\n";
+  }
+  if (diagnostics_.empty())
+    ss << "# no diagnostics from rvinci; is the display enabled?\n";
+
+  std::cout << ss.str() << std::flush;
+  if (!output_.empty())
+  {
+    std::ofstream out(output_.c_str(), std::ios::out | std::ios::trunc);
+    out << ss.str();
+    if (!out)
+      ROS_ERROR_STREAM("replay_benchmark: cannot write '" << output_ << "'");
+  }
+}
+
+} // namespace rvinci
+
+int main(int argc, char** argv)
+{
+  ros::init(argc, argv, "replay_benchmark");
+  rvinci::ReplayBenchmark benchmark;
+  if (!benchmark.init())
+    return 1;
+  ros::spin();
+  return 0;
+}
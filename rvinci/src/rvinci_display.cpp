@@ -27,7 +27,16 @@
  */
 
 #include "rvinci/rvinci_display.h"
+#include <OGRE/OgreMaterialManager.h>
+#include <OGRE/OgreTechnique.h>
+#include <OGRE/OgrePass.h>
+#include <OGRE/OgreTextureUnitState.h>
+#include <OGRE/OgreTextureManager.h>
+#include <OGRE/OgreRenderTexture.h>
+#include <OGRE/OgreSceneManager.h>
+#include <OGRE/OgreViewport.h>
 #include <fstream>
+#include <sstream>
 #include <ctime>
 
 #define _LEFT 0
@@ -48,7 +57,7 @@ rvinciDisplay::rvinciDisplay()
   , sys_init_(true)
 {
   std::string rviz_path = ros::package::getPath(ROS_PACKAGE_NAME);
-  Ogre::ResourceGroupManager::getSingleton().addResourceLocation( rviz_path + "/ogre_media", "FileSystem", ROS_PACKAGE_NAME );
+  Ogre::ResourceGroupManager::getSingleton().addResourceLocation( rviz_path + "/ogre_media", "FileSystem", ROS_PACKAGE_NAME, true );
   Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup(ROS_PACKAGE_NAME);
 
   prop_ros_topic_ = new rviz::RosTopicProperty("Input Topic","/davinci_msg"
@@ -71,27 +80,161 @@ rvinciDisplay::rvinciDisplay()
                                                  "Position of scene node to world base frame",this);
   property_camrot_ = new rviz::QuaternionProperty("Camera Orientation",Ogre::Quaternion(0,0,0,1),
                                                   "Orientation of the camera",this);
+  prop_sync_stereo_ = new rviz::BoolProperty("Synchronize Stereo",false,
+                                             "Only present left/right frames whose header stamps match",
+                                             this, SLOT (updateSyncSettings()));
+  prop_sync_slop_ = new rviz::FloatProperty("Sync Slop",0.02,
+                                            "Largest stamp difference (s) accepted for a stereo pair",
+                                            prop_sync_stereo_, SLOT (updateSyncSettings()), this);
+  prop_sync_slop_->setMin(0.0);
+  prop_sync_queue_size_ = new rviz::IntProperty("Sync Queue Size",5,
+                                                "Frames kept per eye while waiting for a partner",
+                                                prop_sync_stereo_, SLOT (updateSyncSettings()), this);
+  prop_sync_queue_size_->setMin(1);
+
+  prop_upload_ring_size_ = new rviz::IntProperty("Upload Ring Size",2,
+                                                 "Background textures per eye used round-robin for video upload",
+                                                 this, SLOT (resetBackgroundTextures()));
+  prop_upload_ring_size_->setMin(1);
+  prop_upload_ring_size_->setMax(4);
+
+  prop_render_rate_ = new rviz::FloatProperty("Render Rate",60.0,
+                                              "Target frame rate (Hz) of the stereo windows, independent of the RViz main view",
+                                              this, SLOT (updateRenderRate()));
+  prop_render_rate_->setMin(1.0);
+  prop_render_rate_->setMax(240.0);
+
+  prop_present_mode_ = new rviz::EnumProperty("Present Mode","Independent",
+                                              "Independent: each window is swapped as soon as it is rendered. "
+                                              "Paired: both eyes are rendered first, then swapped together.",
+                                              this);
+  prop_present_mode_->addOption("Independent", PRESENT_INDEPENDENT);
+  prop_present_mode_->addOption("Paired", PRESENT_PAIRED);
+  prop_vsync_ = new rviz::BoolProperty("VSync",true,
+                                       "Synchronize buffer swaps of the stereo windows with the display refresh",
+                                       this, SLOT (updateVSync()));
+  prop_adaptive_present_ = new rviz::BoolProperty("Adaptive Present",false,
+                                                  "Skip frames when neither the video, the camera nor the cursors changed",
+                                                  this);
+
+  prop_stereo_output_ = new rviz::EnumProperty("Stereo Output","Dual Window",
+                                               "How both eyes reach the console: two windows, or one window "
+                                               "split side-by-side, top-bottom, row-interleaved or quad-buffered",
+                                               this, SLOT (layoutViewports()));
+  prop_stereo_output_->addOption("Dual Window", OUTPUT_DUAL_WINDOW);
+  prop_stereo_output_->addOption("Side-by-Side", OUTPUT_SIDE_BY_SIDE);
+  prop_stereo_output_->addOption("Top-Bottom", OUTPUT_TOP_BOTTOM);
+  prop_stereo_output_->addOption("Row Interleaved", OUTPUT_ROW_INTERLEAVED);
+  prop_stereo_output_->addOption("Quad Buffer", OUTPUT_QUAD_BUFFER);
+  prop_swap_eyes_ = new rviz::BoolProperty("Swap Eyes",false,
+                                           "Exchange the left and right images in the stereo output",
+                                           prop_stereo_output_, SLOT (layoutViewports()), this);
+  prop_dynamic_resolution_ = new rviz::BoolProperty("Dynamic Resolution",false,
+                                                    "Render the 3D overlay at a reduced resolution that follows the frame time; "
+                                                    "the video stays at full resolution",
+                                                    this, SLOT (layoutViewports()));
+  prop_target_frame_time_ = new rviz::FloatProperty("Target Frame Time",16.0,
+                                                    "Frame time (ms) the resolution scale is adjusted to meet",
+                                                    prop_dynamic_resolution_);
+  prop_target_frame_time_->setMin(1.0);
+  prop_min_resolution_scale_ = new rviz::FloatProperty("Min Resolution Scale",0.5,
+                                                       "Smallest fraction of the window resolution the overlay is rendered at",
+                                                       prop_dynamic_resolution_);
+  prop_min_resolution_scale_->setMin(0.25);
+  prop_min_resolution_scale_->setMax(1.0);
+  prop_video_latency_trace_ = new rviz::StringProperty("Video Latency Trace","",
+                                                       "CSV file receiving the capture, arrival, upload and swap times "
+                                                       "of every presented video frame; empty to disable",
+                                                       this, SLOT (updateVideoLatencyTrace()));
+  prop_video_latency_overlay_ = new rviz::BoolProperty("Video Latency Overlay",false,
+                                                       "Show the glass-to-glass video latency of each eye in the stereo view",
+                                                       this, SLOT (updateVideoLatencyOverlay()));
+  for (int i = 0; i < 2; ++i)
+  {
+    video_latency_node_[i] = 0;
+    video_latency_text_[i] = 0;
+  }
+  resolution_scale_ = 1.0f;
+  frame_time_avg_ = 0.0;
+  swap_time_ = 0.0;
+  layout_scale_ = 0.0f;
+  stereo_output_ = OUTPUT_DUAL_WINDOW;
+  composite_scene_ = 0;
+  composite_camera_ = 0;
+  composite_rect_ = 0;
+  viewport_[_LEFT] = viewport_[_RIGHT] = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    overlay_rect_[i] = 0;
+    composite_bg_rect_[i] = 0;
+    layout_size_[i][0] = layout_size_[i][1] = 0;
+  }
+
+  render_timer_ = new QTimer(this);
+  render_timer_->setTimerType(Qt::PreciseTimer);
+  connect(render_timer_, SIGNAL(timeout()), this, SLOT(renderStereo()));
+  render_interval_sum_ = render_interval_max_ = 0.0;
+  render_time_sum_ = render_time_max_ = 0.0;
+  render_count_ = render_tick_count_ = present_skip_count_ = 0;
+  scene_dirty_ = true;
+
+  sync_enabled_ = false;
+  presented_sync_ = false;
+  sync_slop_ = prop_sync_slop_->getFloat();
+  sync_queue_size_ = prop_sync_queue_size_->getInt();
+  sync_matched_ = sync_mismatched_ = sync_overflow_ = sync_superseded_ = 0;
+  for (int i = 0; i < 2; ++i)
+  {
+    frame_seq_[i] = uploaded_seq_[i] = 0;
+    upload_count_[i] = upload_skip_count_[i] = 0;
+  }
+
   camera_[_LEFT] = 0;
   camera_[_RIGHT]= 0;
+  frame_epoch_ = 0;
+  camera_epoch_ = 0;
+  projection_dirty_ = false;
+  fx_ = fy_ = tx_ = cx_ = cy_ = 0.0;
+  img_width_ = img_height_ = 0.0;
 
   camera_ipd_ = Ogre::Vector3(0.0,0.0,0.0);
 
-  buffer_[0] = NULL;
-  buffer_[1] = NULL;
-  backgroundImage_[0] = NULL;
-  backgroundImage_[1] = NULL;
+  image_nh_.setCallbackQueue(&image_queue_);
+
   rect_[0] = NULL;
   rect_[1] = NULL;
   material_[0].setNull();
   material_[1].setNull();
-  texture_[0].setNull();
-  texture_[1].setNull();
+  texture_index_[0] = 0;
+  texture_index_[1] = 0;
+  video_error_[0] = false;
+  video_error_[1] = false;
 }
 
 rvinciDisplay::~rvinciDisplay()
 {
-  window_->removeViewport(0);
-  window_R_->removeViewport(0);
+  if (image_spinner_)
+  {
+    image_spinner_->stop();
+  }
+  subscriber_lcam_.shutdown();
+  subscriber_rcam_.shutdown();
+
+  if (window_)
+    window_->removeAllViewports();
+  if (window_R_)
+    window_R_->removeAllViewports();
+  destroyEyeTargets();
+  if (composite_scene_)
+  {
+    delete composite_rect_;
+    for (int i = 0; i < 2; ++i)
+    {
+      delete overlay_rect_[i];
+      delete composite_bg_rect_[i];
+    }
+    Ogre::Root::getSingleton().destroySceneManager(composite_scene_);
+  }
   for(int i = 0; i<2; ++i)
   {
     if (viewport_[i])
@@ -106,6 +249,16 @@ rvinciDisplay::~rvinciDisplay()
       camera_[i] = 0;
     }
   }
+  for (int i = 0; i < 2; ++i)
+  {
+    if (!video_latency_node_[i])
+      continue;
+    video_latency_node_[i]->detachObject(video_latency_text_[i]);
+    scene_manager_->destroySceneNode(video_latency_node_[i]);
+    delete video_latency_text_[i];
+    video_latency_node_[i] = 0;
+    video_latency_text_[i] = 0;
+  }
   if (camera_node_)
   {
     camera_node_->getParentSceneNode()->removeChild(camera_node_);
@@ -151,8 +304,13 @@ void rvinciDisplay::onInitialize()
   camera_node_ = scene_manager_->getRootSceneNode()->createChildSceneNode();
   target_node_ = scene_manager_->getRootSceneNode()->createChildSceneNode();
   image_node_ = scene_manager_->getRootSceneNode()->createChildSceneNode("Background");
+  frame_manager_.setFixedFrame("base_link");
 
   pubsubSetup();
+  ros::NodeHandle trace_nh(nh_, "rvinci");
+  trace_service_.advertise(trace_nh, "rviz");
+  image_spinner_.reset(new ros::AsyncSpinner(1, &image_queue_));
+  image_spinner_->start();
 
   MTM_mm_ = true;
   start_measurement_PSM_[_LEFT] = false;
@@ -180,28 +338,20 @@ void rvinciDisplay::onInitialize()
 
 void rvinciDisplay::update(float wall_dt, float ros_dt)
 {
-  if( backgroundImage_[0] != NULL ){
-    Ogre::Box b( 0, 0, 0,  
-		 backgroundImage_[0]->getWidth(),
-		 backgroundImage_[0]->getHeight(), 1 );
-    texture_[0]->getBuffer()->blitFromMemory( backgroundImage_[0]->getPixelBox(), b );
-  }
-
-  if( backgroundImage_[1] != NULL ){
-    Ogre::Box b( 0, 0, 0,
-		 backgroundImage_[1]->getWidth(),
-		 backgroundImage_[1]->getHeight(), 1 );
-    texture_[1]->getBuffer()->blitFromMemory( backgroundImage_[1]->getPixelBox(), b );
-  }
-
-  cameraUpdate();
-  window_ = render_widget_->getRenderWindow();
-  window_->update(false);
-  window_R_ = render_widget_R_->getRenderWindow();
-  window_R_->update(false);
-
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::update");
   rvmsg_.header.stamp = ros::Time::now();
   publisher_rvinci_.publish(rvmsg_);
+  // Remember which MTM sample this message carries, for the motion-to-photon latency
+  if (!mtm_stamp_.isZero())
+  {
+    InputSample sample;
+    sample.published = rvmsg_.header.stamp;
+    sample.arrival = mtm_stamp_;
+    sample.stamp = mtm_sample_stamp_;
+    input_stamps_.push_back(sample);
+    if (input_stamps_.size() > MAX_INPUT_STAMPS)
+      input_stamps_.pop_front();
+  }
 
   publishMeasurementMarkers();
 
@@ -241,6 +391,423 @@ void rvinciDisplay::update(float wall_dt, float ros_dt)
   }
 }
 
+void rvinciDisplay::renderStereo()
+{
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::renderStereo");
+  ros::WallTime start = ros::WallTime::now();
+  if (!last_render_time_.isZero())
+  {
+    double interval = (start - last_render_time_).toSec();
+    render_interval_sum_ += interval;
+    render_interval_max_ = std::max(render_interval_max_, interval);
+    ++render_tick_count_;
+  }
+  last_render_time_ = start;
+  swap_time_ = 0.0;
+
+  bool new_video = false;
+  ros::WallTime upload_start = ros::WallTime::now();
+  bool sync = sync_enabled_;
+  if (sync != presented_sync_)
+  {
+    discardVideoFrames();
+    presented_sync_ = sync;
+  }
+  if (sync)
+  {
+    bool fresh = video_pairs_.update();
+    for (int i = 0; i < 2; ++i)
+      new_video |= uploadFrame(i, video_pairs_.readSlot().eye[i], fresh);
+    updateSyncStatus();
+  }
+  else
+  {
+    for (int i = 0; i < 2; ++i)
+    {
+      bool fresh = video_frames_[i].update();
+      new_video |= uploadFrame(i, video_frames_[i].readSlot(), fresh);
+    }
+  }
+  if (new_video)
+    upload_time_.record((ros::WallTime::now() - upload_start).toSec());
+  updateUploadStatus();
+
+  ++frame_epoch_;
+  cameraUpdate();
+  for (int i = 0; i < 2; ++i)
+  {
+    if (!video_latency_node_[i])
+      continue;
+    // Held in front of each eye, above the centre of its view
+    video_latency_node_[i]->setPosition(camera_[i]->getDerivedPosition() +
+                                        camera_[i]->getDerivedOrientation() * Ogre::Vector3(0.0f, 0.25f, -1.0f));
+    video_latency_node_[i]->setOrientation(camera_[i]->getDerivedOrientation());
+  }
+
+  if (prop_adaptive_present_->getBool() && !new_video && !scene_dirty_ &&
+      camera_[_LEFT]->getDerivedPosition() == presented_camera_pos_ &&
+      camera_[_LEFT]->getDerivedOrientation() == presented_camera_ori_ &&
+      (start - last_present_time_).toSec() < MAX_PRESENT_INTERVAL)
+  {
+    ++present_skip_count_;
+    updateFramePacingStatus();
+    return;
+  }
+  scene_dirty_ = false;
+  presented_camera_pos_ = camera_[_LEFT]->getDerivedPosition();
+  presented_camera_ori_ = camera_[_LEFT]->getDerivedOrientation();
+  last_present_time_ = start;
+
+  // Offscreen targets follow the window size and the resolution scale
+  bool offscreen = !eye_texture_[_LEFT].isNull() || !overlay_texture_[_LEFT].isNull();
+  if ((offscreen && (window_->getWidth() != layout_size_[_LEFT][0] || window_->getHeight() != layout_size_[_LEFT][1] ||
+                     window_R_->getWidth() != layout_size_[_RIGHT][0] || window_R_->getHeight() != layout_size_[_RIGHT][1])))
+  {
+    layoutViewports();
+  }
+  if (layout_scale_ > 0.0f && layout_scale_ != resolution_scale_)
+    applyResolutionScale();
+
+  for (size_t t = 0; t < stereo_targets_.size(); ++t)
+  {
+    stereo_targets_[t]->update(false);
+  }
+  if (prop_present_mode_->getOptionInt() == PRESENT_PAIRED)
+  {
+    // All back buffers are complete; flip them back to back so they land on the same vblank.
+    ros::WallTime swap_start = ros::WallTime::now();
+    for (size_t w = 0; w < stereo_windows_.size(); ++w)
+    {
+      stereo_windows_[w]->swapBuffers();
+    }
+    swap_time_ += (ros::WallTime::now() - swap_start).toSec();
+  }
+  // Work of the frame; with VSync on the swaps block until the vertical blank
+  double render_time = (ros::WallTime::now() - start).toSec() - swap_time_;
+
+  if (!pending_input_stamp_.isZero())
+  {
+    motion_to_photon_.record((ros::Time::now() - pending_input_stamp_).toSec());
+    presented_input_stamp_ = pending_input_stamp_;
+    pending_input_stamp_ = ros::Time();
+  }
+  updateLatencyStatus();
+  recordVideoLatency(ros::Time::now());
+  updateVideoLatencyStatus();
+
+  double duration = (ros::WallTime::now() - start).toSec();
+  render_time_sum_ += duration;
+  render_time_max_ = std::max(render_time_max_, duration);
+  ++render_count_;
+  frame_time_.record(duration);
+  updateTimingDiagnostics();
+  if (layout_scale_ > 0.0f)
+    updateResolutionScale(render_time);
+  updateFramePacingStatus();
+}
+
+void rvinciDisplay::updateLatencyStatus()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - latency_status_time_).toSec() < 1.0 || motion_to_photon_.count() == 0)
+    return;
+  latency_status_time_ = now;
+
+  const double ms = 1000.0;
+  std::stringstream ss;
+  ss.precision(1);
+  ss << std::fixed << "p50 " << motion_to_photon_.quantile(0.5) * ms << " ms, p99 "
+     << motion_to_photon_.quantile(0.99) * ms << " ms, max " << motion_to_photon_.max() * ms
+     << " ms over " << motion_to_photon_.count() << " frames";
+  setStatusStd(rviz::StatusProperty::Ok, "Motion To Photon", ss.str());
+
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "rvinci: motion to photon";
+  status.hardware_id = "rvinci";
+  status.message = ss.str();
+  const double quantiles[] = {0.5, 0.9, 0.99};
+  const char* const keys[] = {"p50 (ms)", "p90 (ms)", "p99 (ms)"};
+  for (int q = 0; q < 3; ++q)
+  {
+    diagnostic_msgs::KeyValue value;
+    value.key = keys[q];
+    value.value = std::to_string(motion_to_photon_.quantile(quantiles[q]) * ms);
+    status.values.push_back(value);
+  }
+  diagnostic_msgs::KeyValue value;
+  value.key = "mean (ms)";
+  value.value = std::to_string(motion_to_photon_.mean() * ms);
+  status.values.push_back(value);
+  value.key = "max (ms)";
+  value.value = std::to_string(motion_to_photon_.max() * ms);
+  status.values.push_back(value);
+  value.key = "frames";
+  value.value = std::to_string(motion_to_photon_.count());
+  status.values.push_back(value);
+  diagnostics.status.push_back(status);
+  publisher_diagnostics_.publish(diagnostics);
+
+  motion_to_photon_.reset();
+}
+
+void rvinciDisplay::updateTimingDiagnostics()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - timing_status_time_).toSec() < 1.0 || frame_time_.count() == 0)
+    return;
+  timing_status_time_ = now;
+
+  const double ms = 1000.0;
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  diagnostic_msgs::DiagnosticStatus status;
+  status.level = diagnostic_msgs::DiagnosticStatus::OK;
+  status.name = "rvinci: frame timing";
+  status.hardware_id = "rvinci";
+  const double quantiles[] = {0.5, 0.9, 0.99};
+  const char* const suffix[] = {" p50 (ms)", " p90 (ms)", " p99 (ms)"};
+  const rvinci::LatencyHistogram* histogram[] = {&frame_time_, &upload_time_};
+  const char* const name[] = {"frame", "upload"};
+  for (int h = 0; h < 2; ++h)
+  {
+    if (histogram[h]->count() == 0)
+      continue;
+    diagnostic_msgs::KeyValue value;
+    for (int q = 0; q < 3; ++q)
+    {
+      value.key = std::string(name[h]) + suffix[q];
+      value.value = std::to_string(histogram[h]->quantile(quantiles[q]) * ms);
+      status.values.push_back(value);
+    }
+    value.key = std::string(name[h]) + " max (ms)";
+    value.value = std::to_string(histogram[h]->max() * ms);
+    status.values.push_back(value);
+    value.key = std::string(name[h]) + "s";
+    value.value = std::to_string(histogram[h]->count());
+    status.values.push_back(value);
+  }
+  diagnostics.status.push_back(status);
+  publisher_diagnostics_.publish(diagnostics);
+
+  frame_time_.reset();
+  upload_time_.reset();
+}
+
+void rvinciDisplay::recordVideoLatency(const ros::Time& presented)
+{
+  for (int i = 0; i < 2; ++i)
+  {
+    VideoTiming& timing = video_timing_[i];
+    if (timing.seq == 0)
+      continue;
+    // Sources without a capture stamp still report the stages inside rvinci.
+    if (!timing.stamp.isZero())
+    {
+      video_latency_[i][STAGE_TRANSPORT].record((timing.received - timing.stamp).toSec());
+      video_latency_[i][STAGE_TOTAL].record((presented - timing.stamp).toSec());
+    }
+    video_latency_[i][STAGE_QUEUE].record((timing.uploaded - timing.received).toSec());
+    video_latency_[i][STAGE_PRESENT].record((presented - timing.uploaded).toSec());
+
+    if (video_trace_.is_open())
+    {
+      video_trace_ << (i == _LEFT ? "left" : "right") << "," << timing.seq << ","
+                   << timing.stamp.toSec() << "," << timing.received.toSec() << ","
+                   << timing.uploaded.toSec() << "," << presented.toSec() << "\n";
+    }
+    timing.seq = 0;
+  }
+}
+
+void rvinciDisplay::updateVideoLatencyStatus()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - video_latency_status_time_).toSec() < 1.0)
+    return;
+  video_latency_status_time_ = now;
+  if (video_trace_.is_open())
+    video_trace_.flush();
+
+  const double ms = 1000.0;
+  const char* const eye[2] = {"left", "right"};
+  const char* const stage[VIDEO_STAGES] = {"capture to arrival", "arrival to upload", "upload to swap", "glass to glass"};
+  diagnostic_msgs::DiagnosticArray diagnostics;
+  diagnostics.header.stamp = ros::Time::now();
+  std::stringstream summary;
+  summary.precision(1);
+  summary << std::fixed;
+  bool measured = false;
+  for (int i = 0; i < 2; ++i)
+  {
+    // Stamp-less sources have no total; fall back to the part measured inside rvinci.
+    const rvinci::LatencyHistogram& shown = video_latency_[i][STAGE_TOTAL].count() ? video_latency_[i][STAGE_TOTAL]
+                                                                                  : video_latency_[i][STAGE_PRESENT];
+    if (shown.count() == 0)
+      continue;
+    summary << (measured ? ", " : "") << eye[i] << " p50 " << shown.quantile(0.5) * ms
+            << " ms / p99 " << shown.quantile(0.99) * ms << " ms";
+    measured = true;
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.level = diagnostic_msgs::DiagnosticStatus::OK;
+    status.name = std::string("rvinci: video latency ") + eye[i];
+    status.hardware_id = "rvinci";
+    for (int s = 0; s < VIDEO_STAGES; ++s)
+    {
+      const rvinci::LatencyHistogram& h = video_latency_[i][s];
+      if (h.count() == 0)
+        continue;
+      diagnostic_msgs::KeyValue value;
+      value.key = std::string(stage[s]) + " p50 (ms)";
+      value.value = std::to_string(h.quantile(0.5) * ms);
+      status.values.push_back(value);
+      value.key = std::string(stage[s]) + " p99 (ms)";
+      value.value = std::to_string(h.quantile(0.99) * ms);
+      status.values.push_back(value);
+      value.key = std::string(stage[s]) + " max (ms)";
+      value.value = std::to_string(h.max() * ms);
+      status.values.push_back(value);
+    }
+    diagnostic_msgs::KeyValue value;
+    value.key = "frames";
+    value.value = std::to_string(video_latency_[i][STAGE_PRESENT].count());
+    status.values.push_back(value);
+    diagnostics.status.push_back(status);
+
+    for (int s = 0; s < VIDEO_STAGES; ++s)
+      video_latency_[i][s].reset();
+  }
+  if (!measured)
+    return;
+
+  for (size_t s = 0; s < diagnostics.status.size(); ++s)
+    diagnostics.status[s].message = summary.str();
+  setStatusStd(rviz::StatusProperty::Ok, "Video Latency", summary.str());
+  publisher_diagnostics_.publish(diagnostics);
+  for (int i = 0; i < 2; ++i)
+    if (video_latency_text_[i])
+      video_latency_text_[i]->setCaption(summary.str());
+}
+
+void rvinciDisplay::updateVideoLatencyTrace()
+{
+  if (video_trace_.is_open())
+    video_trace_.close();
+  std::string path = prop_video_latency_trace_->getStdString();
+  if (path.empty())
+  {
+    deleteStatusStd("Video Latency Trace");
+    return;
+  }
+  video_trace_.open(path.c_str(), std::ios::out | std::ios::trunc);
+  if (!video_trace_.is_open())
+  {
+    setStatusStd(rviz::StatusProperty::Error, "Video Latency Trace", "Cannot open '" + path + "'");
+    return;
+  }
+  // Absolute times (s); stamp is the capture time written by the camera driver.
+  video_trace_.precision(6);
+  video_trace_ << std::fixed << "eye,seq,stamp,received,uploaded,presented\n";
+  setStatusStd(rviz::StatusProperty::Ok, "Video Latency Trace", "Recording to '" + path + "'");
+}
+
+void rvinciDisplay::updateVideoLatencyOverlay()
+{
+  // Inside the eye's mask but apart from its video background, so the overlay targets can draw it too;
+  // the main RViz view never sees it.
+  static const Ogre::uint32 visibility[2] = {0x02, 0x20};
+  bool visible = prop_video_latency_overlay_->getBool();
+  for (int i = 0; i < 2; ++i)
+  {
+    if (!visible)
+    {
+      if (video_latency_node_[i])
+        video_latency_node_[i]->setVisible(false);
+      continue;
+    }
+    if (!video_latency_node_[i])
+    {
+      video_latency_text_[i] = new rviz::MovableText("Video latency: waiting for frames", "Liberation Sans", 0.04f);
+      video_latency_text_[i]->setTextAlignment(rviz::MovableText::H_CENTER, rviz::MovableText::V_ABOVE);
+      video_latency_text_[i]->showOnTop();
+      video_latency_text_[i]->setVisibilityFlags( visibility[i] );
+      video_latency_node_[i] = scene_manager_->getRootSceneNode()->createChildSceneNode();
+      video_latency_node_[i]->attachObject(video_latency_text_[i]);
+    }
+    video_latency_node_[i]->setVisible(true);
+  }
+  scene_dirty_ = true;
+}
+
+void rvinciDisplay::updateResolutionScale(double render_time)
+{
+  // Swaps are left out so VSync does not pin the time at the refresh period; a GPU-bound
+  // frame still shows up here, in the texture locks and draws that wait for the GPU.
+  frame_time_avg_ += 0.1 * (render_time - frame_time_avg_);
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - resolution_time_).toSec() < RESOLUTION_INTERVAL)
+    return;
+  resolution_time_ = now;
+
+  double target = prop_target_frame_time_->getFloat() / 1000.0;
+  float scale = resolution_scale_;
+  if (frame_time_avg_ > target)
+    scale -= RESOLUTION_STEP;
+  else if (frame_time_avg_ < RESOLUTION_HEADROOM * target)
+    scale += RESOLUTION_STEP;
+  // Whole steps only, so the targets are rebuilt on real changes and not on jitter
+  scale = std::floor(scale / RESOLUTION_STEP + 0.5f) * RESOLUTION_STEP;
+  resolution_scale_ = std::max(prop_min_resolution_scale_->getFloat(), std::min(1.0f, scale));
+
+  std::stringstream ss;
+  ss.precision(1);
+  ss << std::fixed << resolution_scale_ * 100.0f << "% at " << frame_time_avg_ * 1000.0 << " ms average render time";
+  bool over = frame_time_avg_ > target && resolution_scale_ <= prop_min_resolution_scale_->getFloat();
+  setStatusStd(over ? rviz::StatusProperty::Warn : rviz::StatusProperty::Ok, "Resolution Scale", ss.str());
+}
+
+void rvinciDisplay::updateRenderRate()
+{
+  // Whole milliseconds only; round down so the target rate is a floor rather than a ceiling.
+  render_timer_->setInterval(std::max(1, (int)std::floor(1000.0 / prop_render_rate_->getFloat())));
+}
+
+void rvinciDisplay::updateVSync()
+{
+  bool vsync = prop_vsync_->getBool();
+  render_widget_->getRenderWindow()->setVSyncEnabled(vsync);
+  render_widget_R_->getRenderWindow()->setVSyncEnabled(vsync);
+}
+
+void rvinciDisplay::updateFramePacingStatus()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - render_status_time_).toSec() < 1.0 || render_tick_count_ == 0)
+    return;
+  render_status_time_ = now;
+
+  std::stringstream ss;
+  ss.precision(1);
+  ss << std::fixed
+     << render_tick_count_ / std::max(render_interval_sum_, 1e-9) << " Hz, interval max "
+     << render_interval_max_ * 1000.0 << " ms";
+  if (render_count_ > 0)
+  {
+    ss << ", render avg " << render_time_sum_ / render_count_ * 1000.0
+       << " ms / max " << render_time_max_ * 1000.0 << " ms";
+  }
+  ss << ", " << present_skip_count_ << " unchanged frames not presented";
+  bool late = render_interval_max_ > 2.0 / prop_render_rate_->getFloat();
+  setStatusStd(late ? rviz::StatusProperty::Warn : rviz::StatusProperty::Ok, "Frame Pacing", ss.str());
+
+  render_interval_sum_ = render_interval_max_ = 0.0;
+  render_time_sum_ = render_time_max_ = 0.0;
+  render_count_ = render_tick_count_ = present_skip_count_ = 0;
+}
+
 //void rvinciDisplay::reset(){}
 void rvinciDisplay::pubsubSetup()
 {
@@ -248,8 +815,8 @@ void rvinciDisplay::pubsubSetup()
   rvmsg_.header.frame_id = "base_link";
 
   subscriber_input_ = nh_.subscribe<rvinci_input_msg::rvinci_input>(subtopic, 10, boost::bind(&rvinciDisplay::inputCallback,this,_1));
-  subscriber_lcam_ = nh_.subscribe<sensor_msgs::Image>( "/jhu_daVinci/stereo_processed/left/image", 10, boost::bind(&rvinciDisplay::leftCallback,this,_1));
-  subscriber_rcam_ = nh_.subscribe<sensor_msgs::Image>( "/jhu_daVinci/stereo_processed/right/image", 10, boost::bind(&rvinciDisplay::rightCallback,this,_1));
+  subscriber_lcam_ = image_nh_.subscribe<sensor_msgs::Image>( "/jhu_daVinci/stereo_processed/left/image", 10, boost::bind(&rvinciDisplay::imageCallback,this,_1,_LEFT));
+  subscriber_rcam_ = image_nh_.subscribe<sensor_msgs::Image>( "/jhu_daVinci/stereo_processed/right/image", 10, boost::bind(&rvinciDisplay::imageCallback,this,_1,_RIGHT));
   subscriber_clutch_ = nh_.subscribe<sensor_msgs::Joy>( "/footpedals/clutch", 10, boost::bind(&rvinciDisplay::clutchCallback,this,_1));
   subscriber_camera_ = nh_.subscribe<sensor_msgs::Joy>( "/footpedals/camera", 10, boost::bind(&rvinciDisplay::cameraCallback,this,_1));
   subscriber_coag_ = nh_.subscribe<sensor_msgs::Joy>( "/footpedals/coag", 10, boost::bind(&rvinciDisplay::coagCallback,this,_1));
@@ -272,103 +839,413 @@ void rvinciDisplay::pubsubSetup()
   
   publisher_markers = nh_.advertise<visualization_msgs::MarkerArray>("rvinci_markers", 10);
   publisher_rvinci_ = nh_.advertise<rvinci_input_msg::rvinci_input>("/rvinci_input_update",10);
+  publisher_diagnostics_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 10);
   publisher_lwrench_ = nh_.advertise<geometry_msgs::WrenchStamped>("/MTML/body/servo_cf", 10);
   publisher_rwrench_ = nh_.advertise<geometry_msgs::WrenchStamped>("/MTMR/body/servo_cf", 10);
   publisher_lgravity_ = nh_.advertise<std_msgs::Bool>("/MTML/use_gravity_compensation", 10);
   publisher_rgravity_ = nh_.advertise<std_msgs::Bool>("/MTMR/use_gravity_compensation", 10);
 }
 
-void rvinciDisplay::leftCallback(const sensor_msgs::ImageConstPtr& img)
+void rvinciDisplay::imageCallback(const sensor_msgs::ImageConstPtr& img, int i)
 {
-
-  if( buffer_[0] == NULL )
-    { buffer_[0] = (unsigned char*)malloc( sizeof(unsigned char*)*img->height*img->step ); }
-
-  if( backgroundImage_[0] == NULL ){
-    backgroundImage_[0] = new Ogre::Image;
-    backgroundImage_[0]->loadDynamicImage(buffer_[0], img->width, img->height, 1, Ogre::PF_BYTE_RGB);
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::imageCallback");
+  // Only slots owned by this thread are touched; Ogre resources are created in update().
+  // Arrival is stamped here so time spent waiting for a partner counts as queueing, not transport.
+  ros::Time received = ros::Time::now();
+  if (!sync_enabled_)
+  {
+    sync_queue_[_LEFT].clear();
+    sync_queue_[_RIGHT].clear();
+    storeFrame(img, received, i, video_frames_[i].writeSlot());
+    video_frames_[i].publish();
+    return;
   }
 
-  if( texture_[0].isNull() ){
-    texture_[0] = Ogre::TextureManager::getSingleton().createManual("BackgroundTextureLeft",
-                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
-                    Ogre::TEX_TYPE_2D,
-                    img->width, img->height, 
-                    0, 
-                    Ogre::PF_BYTE_BGR,
-                    Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-    texture_[0]->loadImage( *(backgroundImage_[0]) );
+  sync_queue_[i].push_back(std::make_pair(img, received));
+  while (sync_queue_[i].size() > (size_t)sync_queue_size_)
+  {
+    sync_queue_[i].pop_front();
+    ++sync_overflow_;
   }
+  matchStereoFrames();
+}
 
-  if( material_[0].isNull() ){
-    material_[0] = Ogre::MaterialManager::getSingleton().create("BackgroundMaterialLeft", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-    material_[0]->getTechnique(0)->getPass(0)->createTextureUnitState("BackgroundTextureLeft");
-    material_[0]->getTechnique(0)->getPass(0)->setDepthCheckEnabled(false);
-    material_[0]->getTechnique(0)->getPass(0)->setDepthWriteEnabled(false);
-    material_[0]->getTechnique(0)->getPass(0)->setLightingEnabled(false);
+void rvinciDisplay::matchStereoFrames()
+{
+  std::deque<std::pair<sensor_msgs::ImageConstPtr, ros::Time> >& left = sync_queue_[_LEFT];
+  std::deque<std::pair<sensor_msgs::ImageConstPtr, ros::Time> >& right = sync_queue_[_RIGHT];
+  double slop = sync_slop_;
+
+  while (!left.empty() && !right.empty())
+  {
+    double dt = (left.front().first->header.stamp - right.front().first->header.stamp).toSec();
+    if (std::fabs(dt) <= slop)
+    {
+      StereoFramePair& pair = video_pairs_.writeSlot();
+      storeFrame(left.front().first, left.front().second, _LEFT, pair.eye[_LEFT]);
+      storeFrame(right.front().first, right.front().second, _RIGHT, pair.eye[_RIGHT]);
+      if (video_pairs_.publish())
+        ++sync_superseded_;
+      ++sync_matched_;
+      left.pop_front();
+      right.pop_front();
+    }
+    else
+    {
+      // Stamps only increase, so the older frame can never find a closer partner.
+      if (dt < 0)
+        left.pop_front();
+      else
+        right.pop_front();
+      ++sync_mismatched_;
+    }
   }
+}
+
+void rvinciDisplay::storeFrame(const sensor_msgs::ImageConstPtr& img, const ros::Time& received, int i,
+                               VideoFrame& frame)
+{
+  frame.seq = ++frame_seq_[i];
+  frame.image = img;
+  frame.received = received;
+}
 
-  if( rect_[0] == NULL ){
-    rect_[0] = new Ogre::Rectangle2D(true);
-    rect_[0]->setCorners(-1.0, 1.0, 1.0, -1.0);
-    rect_[0]->setMaterial("BackgroundMaterialLeft");
-    rect_[0]->setRenderQueueGroup(Ogre::RENDER_QUEUE_BACKGROUND);
-    rect_[0]->setVisibilityFlags( 0x0F );
+void rvinciDisplay::updateSyncSettings()
+{
+  sync_slop_ = prop_sync_slop_->getFloat();
+  sync_queue_size_ = prop_sync_queue_size_->getInt();
+  sync_enabled_ = prop_sync_stereo_->getBool();
+  if (!sync_enabled_)
+    deleteStatusStd("Stereo Sync");
+}
 
-    Ogre::AxisAlignedBox aabInf;
-    aabInf.setInfinite();
-    rect_[0]->setBoundingBox(aabInf);
-    image_node_->attachObject(rect_[0]);
+void rvinciDisplay::updateSyncStatus()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - sync_status_time_).toSec() < 1.0)
+    return;
+  sync_status_time_ = now;
 
+  std::stringstream ss;
+  ss << sync_matched_.load() << " pairs, " << sync_mismatched_.load() << " mismatched, "
+     << sync_overflow_.load() << " overflowed, " << sync_superseded_.load() << " dropped before display";
+  bool dropping = sync_mismatched_.load() + sync_overflow_.load() > 0;
+  setStatusStd(dropping ? rviz::StatusProperty::Warn : rviz::StatusProperty::Ok, "Stereo Sync", ss.str());
+}
+
+//!Describes how an image is split into texture planes, or returns false if it cannot be shown.
+static bool describeVideoLayout(const sensor_msgs::Image& img, VideoLayout& layout, std::string& error)
+{
+  namespace enc = sensor_msgs::image_encodings;
+  const std::string& e = img.encoding;
+
+  layout = VideoLayout();
+  layout.planes = 1;
+  layout.width[0] = img.width;
+  layout.height[0] = img.height;
+  layout.offset[0] = 0;
+  layout.step[0] = img.step;
+  layout.bayer_origin[0] = layout.bayer_origin[1] = 0.0f;
+  size_t rows = img.height;
+
+  if (e == enc::RGB8)       layout.format[0] = Ogre::PF_BYTE_RGB;
+  else if (e == enc::BGR8)  layout.format[0] = Ogre::PF_BYTE_BGR;
+  else if (e == enc::RGBA8) layout.format[0] = Ogre::PF_BYTE_RGBA;
+  else if (e == enc::BGRA8) layout.format[0] = Ogre::PF_BYTE_BGRA;
+  else if (e == enc::MONO8) layout.format[0] = Ogre::PF_L8;
+  else if (e == enc::YUV422 || e == "yuv422_yuy2")
+  {
+    // Two pixels per RGBA texel
+    layout.format[0] = Ogre::PF_BYTE_RGBA;
+    layout.width[0] = img.width / 2;
+    layout.program = (e == enc::YUV422) ? "rvinci/UYVYToRGB" : "rvinci/YUYVToRGB";
+  }
+  else if (e == "nv12" || e == "nv21")
+  {
+    layout.planes = 2;
+    layout.format[0] = Ogre::PF_L8;
+    layout.format[1] = Ogre::PF_BYTE_LA;
+    layout.width[1] = img.width / 2;
+    layout.height[1] = img.height / 2;
+    layout.offset[1] = (size_t)img.step * img.height;
+    layout.step[1] = img.step;
+    layout.program = (e == "nv12") ? "rvinci/NV12ToRGB" : "rvinci/NV21ToRGB";
+    rows = img.height + img.height / 2;
+  }
+  else if (e == enc::BAYER_RGGB8 || e == enc::BAYER_GRBG8 || e == enc::BAYER_GBRG8 || e == enc::BAYER_BGGR8)
+  {
+    layout.format[0] = Ogre::PF_L8;
+    layout.program = "rvinci/BayerToRGB";
+    layout.bayer_origin[0] = (e == enc::BAYER_GRBG8 || e == enc::BAYER_BGGR8) ? 1.0f : 0.0f;
+    layout.bayer_origin[1] = (e == enc::BAYER_GBRG8 || e == enc::BAYER_BGGR8) ? 1.0f : 0.0f;
+  }
+  else
+  {
+    error = "Unsupported encoding '" + e + "'";
+    return false;
   }
 
-  memcpy( (void*)buffer_[0], (void*)img->data.data(), img->step*img->height );
+  // 4:2:2 halves the width only, 4:2:0 both width and height
+  bool half_width = !layout.program.empty() && layout.program != "rvinci/BayerToRGB";
+  bool half_height = layout.planes == 2;
+  if (img.width == 0 || img.height == 0 || (half_width && img.width % 2) || (half_height && img.height % 2))
+  {
+    error = "Invalid image size for encoding '" + e + "'";
+    return false;
+  }
+  size_t row_size = layout.width[0] * Ogre::PixelUtil::getNumElemBytes(layout.format[0]);
+  if (img.step < row_size || img.data.size() < (size_t)img.step * rows)
+  {
+    error = "Image size does not match its width, height and step";
+    return false;
+  }
+  return true;
 }
 
-void rvinciDisplay::rightCallback(const sensor_msgs::ImageConstPtr& img){
+//!Writes src straight into the texture's locked buffer, converting only if the formats differ.
+/*!src_step is the row stride of the source in bytes, which need not be a whole
+ * number of pixels.
+ */
+static void streamToTexture(const Ogre::HardwarePixelBufferSharedPtr& buffer, const Ogre::PixelBox& src,
+                            size_t src_step)
+{
+  const Ogre::PixelBox& dst = buffer->lock(Ogre::Box(0, 0, src.getWidth(), src.getHeight()),
+                                           Ogre::HardwareBuffer::HBL_DISCARD);
+  size_t pixel_size = Ogre::PixelUtil::getNumElemBytes(src.format);
+  if (dst.format == src.format)
+  {
+    size_t row_size = src.getWidth() * pixel_size;
+    const unsigned char* in = static_cast<const unsigned char*>(src.data);
+    unsigned char* out = static_cast<unsigned char*>(dst.data);
+    for (size_t y = 0; y < src.getHeight(); ++y)
+    {
+      memcpy(out + y*dst.rowPitch*pixel_size, in + y*src_step, row_size);
+    }
+  }
+  else if (src_step % pixel_size == 0)
+  {
+    Ogre::PixelBox rows = src;
+    rows.rowPitch = src_step / pixel_size;
+    Ogre::PixelUtil::bulkPixelConversion(rows, dst);
+  }
+  else
+  {
+    // A pitch counts whole pixels, so a padded step is converted one row at a time.
+    size_t dst_pixel_size = Ogre::PixelUtil::getNumElemBytes(dst.format);
+    unsigned char* in = static_cast<unsigned char*>(src.data);
+    unsigned char* out = static_cast<unsigned char*>(dst.data);
+    for (size_t y = 0; y < src.getHeight(); ++y)
+    {
+      Ogre::PixelBox in_row(src.getWidth(), 1, 1, src.format, in + y*src_step);
+      Ogre::PixelBox out_row(src.getWidth(), 1, 1, dst.format, out + y*dst.rowPitch*dst_pixel_size);
+      Ogre::PixelUtil::bulkPixelConversion(in_row, out_row);
+    }
+  }
+  buffer->unlock();
+}
 
-  if( buffer_[1] == NULL )
-    { buffer_[1] = (unsigned char*)malloc( sizeof(unsigned char*)*img->height*img->step ); }
+void rvinciDisplay::discardVideoFrames()
+{
+  // A slot published before the switch is taken and emptied with the one already read.
+  video_pairs_.update();
+  video_pairs_.readSlot() = StereoFramePair();
+  for (int i = 0; i < 2; ++i)
+  {
+    video_frames_[i].update();
+    video_frames_[i].readSlot() = VideoFrame();
+  }
+}
 
-  if( backgroundImage_[1] == NULL ){
-    backgroundImage_[1] = new Ogre::Image;
-    backgroundImage_[1]->loadDynamicImage(buffer_[1], img->width, img->height, 1, Ogre::PF_BYTE_RGB);
+bool rvinciDisplay::uploadFrame(int i, const VideoFrame& frame, bool fresh)
+{
+  static const char* const texture_name[2] = {"BackgroundTextureLeft", "BackgroundTextureRight"};
+  static const char* const material_name[2] = {"BackgroundMaterialLeft", "BackgroundMaterialRight"};
+  static const char* const status_name[2] = {"Video Left", "Video Right"};
+  static const Ogre::uint32 visibility[2] = {0x01, 0x10};
+
+  if (!frame.image)
+    return false;
+  const sensor_msgs::Image& img = *frame.image;
+
+  // Nothing arrived since the last tick, the texture already holds this frame.
+  // uploaded_seq_ is 0 after the textures were rebuilt, which refills them from the frame held.
+  if ((!fresh && uploaded_seq_[i] != 0) || frame.seq == uploaded_seq_[i])
+  {
+    ++upload_skip_count_[i];
+    return false;
   }
+  // A rejected frame is not retried on every tick.
+  uploaded_seq_[i] = frame.seq;
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::uploadFrame");
 
-  if( texture_[1].isNull() ){
-    texture_[1] = Ogre::TextureManager::getSingleton().createManual("BackgroundTextureRight",
-                    Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
-                    Ogre::TEX_TYPE_2D,
-                    img->width, img->height,
-                    0, 
-                    Ogre::PF_BYTE_BGR,
-                    Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE);
-    texture_[1]->loadImage( *(backgroundImage_[1]) );
+  VideoLayout layout;
+  std::string error;
+  if (!describeVideoLayout(img, layout, error))
+  {
+    setStatusStd(rviz::StatusProperty::Error, status_name[i], error);
+    video_error_[i] = true;
+    return false;
+  }
+
+  // Size or encoding changed: rebuild the ring before anything reads the new frame.
+  if (!texture_[i].empty() && !video_layout_[i].matches(layout))
+  {
+    ROS_INFO_STREAM("rvinci: " << status_name[i] << " changed to " << img.width << "x" << img.height
+                    << " " << img.encoding);
+    destroyBackgroundTextures(i);
+    uploaded_seq_[i] = frame.seq;
   }
 
-  if( material_[1].isNull() ){
-    material_[1] = Ogre::MaterialManager::getSingleton().create("BackgroundMaterialRight", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
-    material_[1]->getTechnique(0)->getPass(0)->createTextureUnitState("BackgroundTextureRight");
-    material_[1]->getTechnique(0)->getPass(0)->setDepthCheckEnabled(false);
-    material_[1]->getTechnique(0)->getPass(0)->setDepthWriteEnabled(false);
-    material_[1]->getTechnique(0)->getPass(0)->setLightingEnabled(false);
+  if( texture_[i].empty() ){
+    int ring_size = prop_upload_ring_size_->getInt();
+    for (int k = 0; k < ring_size; ++k)
+    {
+      for (int p = 0; p < layout.planes; ++p)
+      {
+        std::stringstream name;
+        name << texture_name[i] << k << "_" << p;
+        // Same layout as the incoming data, so the upload is a plain copy.
+        texture_[i].push_back(Ogre::TextureManager::getSingleton().createManual(name.str(),
+                                Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+                                Ogre::TEX_TYPE_2D,
+                                layout.width[p], layout.height[p],
+                                0,
+                                layout.format[p],
+                                Ogre::TU_DYNAMIC_WRITE_ONLY_DISCARDABLE));
+      }
+    }
+    texture_index_[i] = 0;
+    video_layout_[i] = layout;
+    video_error_[i] = true;
+
+    if( material_[i].isNull() ){
+      material_[i] = Ogre::MaterialManager::getSingleton().create(material_name[i], Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+      material_[i]->getTechnique(0)->getPass(0)->setDepthCheckEnabled(false);
+      material_[i]->getTechnique(0)->getPass(0)->setDepthWriteEnabled(false);
+      material_[i]->getTechnique(0)->getPass(0)->setLightingEnabled(false);
+    }
+    configureBackgroundMaterial(i);
+    createCompositeBackground(i);
+  }
+  if (video_error_[i])
+  {
+    std::stringstream ss;
+    ss << img.width << "x" << img.height << " " << img.encoding;
+    setStatusStd(rviz::StatusProperty::Ok, status_name[i], ss.str());
+    video_error_[i] = false;
   }
 
-  if( rect_[1] == NULL ){
-    rect_[1] = new Ogre::Rectangle2D(true);
-    rect_[1]->setCorners(-1.0, 1.0, 1.0, -1.0);
-    rect_[1]->setMaterial("BackgroundMaterialRight");
-    rect_[1]->setRenderQueueGroup(Ogre::RENDER_QUEUE_BACKGROUND);
-    rect_[1]->setVisibilityFlags( 0xF0 );
+  if( rect_[i] == NULL ){
+    rect_[i] = new Ogre::Rectangle2D(true);
+    rect_[i]->setCorners(-1.0, 1.0, 1.0, -1.0);
+    rect_[i]->setMaterial(material_name[i]);
+    rect_[i]->setRenderQueueGroup(Ogre::RENDER_QUEUE_BACKGROUND);
+    rect_[i]->setVisibilityFlags( visibility[i] );
 
     Ogre::AxisAlignedBox aabInf;
     aabInf.setInfinite();
-    rect_[1]->setBoundingBox(aabInf);
-    image_node_->attachObject(rect_[1]);
+    rect_[i]->setBoundingBox(aabInf);
+    image_node_->attachObject(rect_[i]);
   }
 
-  memcpy( (void*)buffer_[1], (void*)img->data.data(), img->step*img->height );
+  // Write into the next slot of the ring while the current one may still be in flight.
+  const VideoLayout& planes = video_layout_[i];
+  texture_index_[i] = (texture_index_[i] + 1) % (texture_[i].size() / planes.planes);
+  Ogre::Pass* pass = material_[i]->getTechnique(0)->getPass(0);
+  for (int p = 0; p < planes.planes; ++p)
+  {
+    const Ogre::TexturePtr& texture = texture_[i][texture_index_[i]*planes.planes + p];
+    Ogre::PixelBox src(planes.width[p], planes.height[p], 1, planes.format[p],
+                       (void*)(img.data.data() + planes.offset[p]));
+    streamToTexture(texture->getBuffer(), src, planes.step[p]);
+    pass->getTextureUnitState(p)->setTextureName(texture->getName());
+  }
+
+  video_timing_[i].seq = frame.seq;
+  video_timing_[i].stamp = img.header.stamp;
+  video_timing_[i].received = frame.received;
+  video_timing_[i].uploaded = ros::Time::now();
+
+  ++upload_count_[i];
+  return true;
+}
 
+void rvinciDisplay::destroyBackgroundTextures(int i)
+{
+  for (size_t k = 0; k < texture_[i].size(); ++k)
+  {
+    Ogre::TextureManager::getSingleton().remove(texture_[i][k]->getHandle());
+  }
+  texture_[i].clear();
+  texture_index_[i] = 0;
+  uploaded_seq_[i] = 0;
+}
+
+void rvinciDisplay::configureBackgroundMaterial(int i)
+{
+  const VideoLayout& layout = video_layout_[i];
+  Ogre::Pass* pass = material_[i]->getTechnique(0)->getPass(0);
+
+  pass->removeAllTextureUnitStates();
+  for (int p = 0; p < layout.planes; ++p)
+  {
+    Ogre::TextureUnitState* unit = pass->createTextureUnitState(texture_[i][p]->getName());
+    unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+    // Packed and mosaic texels hold several pixels and must not be blended.
+    if (!layout.program.empty() && p == 0)
+      unit->setTextureFiltering(Ogre::TFO_NONE);
+  }
+
+  pass->setFragmentProgram(layout.program);
+  if (layout.program == "rvinci/BayerToRGB")
+  {
+    pass->getFragmentProgramParameters()->setNamedConstant("bayer_origin", layout.bayer_origin, 1, 2);
+  }
+  material_[i]->load();
+
+  if (rect_[i])
+    rect_[i]->setVisible(true);
+  if (composite_bg_rect_[i])
+    composite_bg_rect_[i]->setVisible(true);
+}
+
+void rvinciDisplay::resetBackgroundTextures()
+{
+  for (int i = 0; i < 2; ++i)
+  {
+    destroyBackgroundTextures(i);
+    if (material_[i].isNull())
+      continue;
+    // Nothing may sample the removed textures; the video stays hidden until the next upload.
+    Ogre::Pass* pass = material_[i]->getTechnique(0)->getPass(0);
+    pass->removeAllTextureUnitStates();
+    pass->setFragmentProgram("");
+    if (rect_[i])
+      rect_[i]->setVisible(false);
+    if (composite_bg_rect_[i])
+      composite_bg_rect_[i]->setVisible(false);
+  }
+}
+
+void rvinciDisplay::updateUploadStatus()
+{
+  ros::WallTime now = ros::WallTime::now();
+  if ((now - upload_status_time_).toSec() < 1.0)
+    return;
+  upload_status_time_ = now;
+
+  std::stringstream ss;
+  ss.precision(1);
+  ss << std::fixed;
+  const char* const eye[2] = {"left", "right"};
+  for (int i = 0; i < 2; ++i)
+  {
+    unsigned long ticks = upload_count_[i] + upload_skip_count_[i];
+    double skipped = ticks ? 100.0 * upload_skip_count_[i] / ticks : 0.0;
+    ss << (i ? ", " : "") << eye[i] << " " << skipped << "% skipped";
+    upload_count_[i] = upload_skip_count_[i] = 0;
+  }
+  setStatusStd(rviz::StatusProperty::Ok, "Texture Upload", ss.str());
 }
 
 void rvinciDisplay::gravityCompensation()
@@ -422,8 +1299,25 @@ void rvinciDisplay::inputCallback(const rvinci_input_msg::rvinci_input::ConstPtr
       grab[i] = getaGrip(r_input->gripper[i].grab, i);
     }
 
+    // MTM arrival and pose stamp of our own messages, the header stamp of input published by other nodes
+    ros::Time input_stamp = r_input->header.stamp;
+    ros::Time sample_stamp = r_input->header.stamp;
+    for (size_t k = 0; k < input_stamps_.size(); ++k)
+    {
+      if (input_stamps_[k].published == r_input->header.stamp)
+      {
+        input_stamp = input_stamps_[k].arrival;
+        sample_stamp = input_stamps_[k].stamp;
+        break;
+      }
+    }
+
     // prop_cam_focus_->setVector(input_pos_[_RIGHT]);
-    publishCursorUpdate(grab);
+    publishCursorUpdate(grab, sample_stamp);
+    scene_dirty_ = true;
+    // The same sample is republished until the MTM moves; only its first appearance is measured.
+    if (input_stamp > presented_input_stamp_)
+      pending_input_stamp_ = input_stamp;
 
     /*
       * inital_vect is constantly calculated, to set origin vector between grippers when
@@ -446,7 +1340,7 @@ void rvinciDisplay::inputCallback(const rvinci_input_msg::rvinci_input::ConstPtr
   // }
 }
 
-void rvinciDisplay::publishCursorUpdate(int grab[2])
+void rvinciDisplay::publishCursorUpdate(int grab[2], const ros::Time& stamp)
 {
   //fixed frame is a parent member from RViz Display, pointing to selected world frame in rviz;
   std::string frame = context_->getFixedFrame().toStdString();
@@ -454,12 +1348,12 @@ void rvinciDisplay::publishCursorUpdate(int grab[2])
   interaction_cursor_msgs::InteractionCursorUpdate rhcursor;
 
   lhcursor.pose.header.frame_id = frame;
-  lhcursor.pose.header.stamp = ros::Time::now();
+  lhcursor.pose.header.stamp = stamp;
   lhcursor.pose.pose = cursor_[_LEFT];
   lhcursor.button_state = grab[_LEFT];
 
   rhcursor.pose.header.frame_id = frame;
-  rhcursor.pose.header.stamp = ros::Time::now();
+  rhcursor.pose.header.stamp = stamp;
   rhcursor.pose.pose = cursor_[_RIGHT];
   rhcursor.button_state = grab[_RIGHT];
 
@@ -497,25 +1391,299 @@ int rvinciDisplay::getaGrip(bool grab, int i)
 
 void rvinciDisplay::cameraSetup()
 {
-  Ogre::ColourValue bg_color = context_->getViewManager()->getRenderPanel()->getViewport()->getBackgroundColour();
-  window_ = render_widget_->getRenderWindow();
-  window_R_ = render_widget_R_->getRenderWindow();
+  bg_color_ = context_->getViewManager()->getRenderPanel()->getViewport()->getBackgroundColour();
 
   camera_[_LEFT] = scene_manager_->createCamera("Left Camera");
   camera_[_RIGHT] = scene_manager_->createCamera("Right Camera");
-
   camera_node_->attachObject(camera_[_LEFT]);
-  viewport_[_LEFT] = window_->addViewport(camera_[_LEFT]);
-  viewport_[_LEFT]->setBackgroundColour(bg_color);
-
   camera_node_->attachObject(camera_[_RIGHT]);
-  viewport_[_RIGHT] = window_R_->addViewport(camera_[_RIGHT]);
-  viewport_[_RIGHT]->setBackgroundColour(bg_color);
-  
+
+  layoutViewports();
+  cameraReset();
+}
+
+void rvinciDisplay::layoutViewports()
+{
+  if (!camera_[_LEFT])
+    return;
+
+  window_ = render_widget_->getRenderWindow();
+  window_R_ = render_widget_R_->getRenderWindow();
+  window_->removeAllViewports();
+  window_R_->removeAllViewports();
+  destroyEyeTargets();
+  stereo_targets_.clear();
+  stereo_windows_.clear();
+
+  stereo_output_ = prop_stereo_output_->getOptionInt();
+  bool quad_buffer = false;
+#if OGRE_STEREO_ENABLE
+  quad_buffer = rviz::RenderSystem::get()->isStereoSupported();
+#endif
+  if (stereo_output_ == OUTPUT_QUAD_BUFFER && !quad_buffer)
+  {
+    setStatusStd(rviz::StatusProperty::Warn, "Stereo Output", "Quad-buffer stereo is not available, using side-by-side");
+    stereo_output_ = OUTPUT_SIDE_BY_SIDE;
+  }
+  else
+  {
+    setStatusStd(rviz::StatusProperty::Ok, "Stereo Output", prop_stereo_output_->getStdString());
+  }
+
+  // first is shown left, top, on even rows or in the left window
+  int first = prop_swap_eyes_->getBool() ? _RIGHT : _LEFT;
+  int second = 1 - first;
+
+  switch (stereo_output_)
+  {
+    case OUTPUT_DUAL_WINDOW:
+      viewport_[first] = window_->addViewport(camera_[first]);
+      viewport_[second] = window_R_->addViewport(camera_[second]);
+      stereo_targets_.push_back(window_);
+      stereo_targets_.push_back(window_R_);
+      stereo_windows_.push_back(window_);
+      stereo_windows_.push_back(window_R_);
+      break;
+    case OUTPUT_SIDE_BY_SIDE:
+      viewport_[first] = window_->addViewport(camera_[first], 0, 0.0f, 0.0f, 0.5f, 1.0f);
+      viewport_[second] = window_->addViewport(camera_[second], 1, 0.5f, 0.0f, 0.5f, 1.0f);
+      break;
+    case OUTPUT_TOP_BOTTOM:
+      viewport_[first] = window_->addViewport(camera_[first], 0, 0.0f, 0.0f, 1.0f, 0.5f);
+      viewport_[second] = window_->addViewport(camera_[second], 1, 0.0f, 0.5f, 1.0f, 0.5f);
+      break;
+    case OUTPUT_QUAD_BUFFER:
+      viewport_[_LEFT] = window_->addViewport(camera_[first], 0);
+      viewport_[_RIGHT] = window_->addViewport(camera_[second], 1);
+#if OGRE_STEREO_ENABLE
+      viewport_[_LEFT]->setDrawBuffer(Ogre::CBT_BACK_LEFT);
+      viewport_[_RIGHT]->setDrawBuffer(Ogre::CBT_BACK_RIGHT);
+#endif
+      std::swap(viewport_[_LEFT], viewport_[first]);
+      break;
+    case OUTPUT_ROW_INTERLEAVED:
+      createCompositeScene();
+      createEyeTargets(window_->getWidth(), window_->getHeight());
+      for (int i = 0; i < 2; ++i)
+      {
+        Ogre::RenderTarget* target = eye_texture_[i]->getBuffer()->getRenderTarget();
+        viewport_[i] = target->addViewport(camera_[i]);
+        stereo_targets_.push_back(target);
+      }
+      composite_material_->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTextureName(eye_texture_[first]->getName());
+      composite_material_->getTechnique(0)->getPass(0)->getTextureUnitState(1)->setTextureName(eye_texture_[second]->getName());
+      window_->addViewport(composite_camera_)->setVisibilityMask( 0x100 );
+      break;
+  }
+  if (stereo_output_ != OUTPUT_DUAL_WINDOW)
+  {
+    stereo_targets_.push_back(window_);
+    stereo_windows_.push_back(window_);
+  }
+
+  for (int i = 0; i < 2; ++i)
+  {
+    viewport_[i]->setBackgroundColour(bg_color_);
+  }
   viewport_[_LEFT]->setVisibilityMask( 0x0F );
   viewport_[_RIGHT]->setVisibilityMask( 0xF0 );
 
-  cameraReset();
+  layout_scale_ = 0.0f;
+  if (prop_dynamic_resolution_->getBool())
+  {
+    if (stereo_output_ == OUTPUT_ROW_INTERLEAVED)
+    {
+      setStatusStd(rviz::StatusProperty::Warn, "Resolution Scale", "Not available with row-interleaved output");
+    }
+    else
+    {
+      resolution_scale_ = std::max(prop_min_resolution_scale_->getFloat(), resolution_scale_);
+      createOverlayTargets();
+      applyResolutionScale();
+    }
+  }
+  else
+  {
+    deleteStatusStd("Resolution Scale");
+  }
+  layout_size_[_LEFT][0] = window_->getWidth();
+  layout_size_[_LEFT][1] = window_->getHeight();
+  layout_size_[_RIGHT][0] = window_R_->getWidth();
+  layout_size_[_RIGHT][1] = window_R_->getHeight();
+
+  render_widget_R_->setVisible(isEnabled() && stereo_output_ == OUTPUT_DUAL_WINDOW);
+  scene_dirty_ = true;
+}
+
+void rvinciDisplay::createCompositeScene()
+{
+  if (composite_scene_)
+    return;
+
+  composite_scene_ = Ogre::Root::getSingleton().createSceneManager(Ogre::ST_GENERIC, "rvinci_composite");
+  composite_camera_ = composite_scene_->createCamera("Composite Camera");
+  Ogre::AxisAlignedBox aabInf;
+  aabInf.setInfinite();
+
+  composite_material_ = Ogre::MaterialManager::getSingleton().create("StereoCompositeMaterial", Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+  Ogre::Pass* pass = composite_material_->getTechnique(0)->getPass(0);
+  pass->setDepthCheckEnabled(false);
+  pass->setDepthWriteEnabled(false);
+  pass->setLightingEnabled(false);
+  for (int i = 0; i < 2; ++i)
+  {
+    Ogre::TextureUnitState* unit = pass->createTextureUnitState();
+    unit->setTextureFiltering(Ogre::TFO_NONE);
+    unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+  }
+  pass->setFragmentProgram("rvinci/RowInterleave");
+
+  composite_rect_ = new Ogre::Rectangle2D(true);
+  composite_rect_->setCorners(-1.0, 1.0, 1.0, -1.0);
+  composite_rect_->setMaterial("StereoCompositeMaterial");
+  composite_rect_->setBoundingBox(aabInf);
+  composite_rect_->setVisibilityFlags( 0x100 );
+  composite_scene_->getRootSceneNode()->attachObject(composite_rect_);
+
+  static const char* const overlay_material_name[2] = {"StereoOverlayMaterialLeft", "StereoOverlayMaterialRight"};
+  static const unsigned int visibility[2] = {0x0F, 0xF0};
+  for (int i = 0; i < 2; ++i)
+  {
+    overlay_material_[i] = Ogre::MaterialManager::getSingleton().create(overlay_material_name[i], Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME);
+    pass = overlay_material_[i]->getTechnique(0)->getPass(0);
+    pass->setDepthCheckEnabled(false);
+    pass->setDepthWriteEnabled(false);
+    pass->setLightingEnabled(false);
+    pass->setSceneBlending(Ogre::SBT_TRANSPARENT_ALPHA);
+    Ogre::TextureUnitState* unit = pass->createTextureUnitState();
+    unit->setTextureFiltering(Ogre::TFO_BILINEAR);
+    unit->setTextureAddressingMode(Ogre::TextureUnitState::TAM_CLAMP);
+
+    overlay_rect_[i] = new Ogre::Rectangle2D(true);
+    overlay_rect_[i]->setCorners(-1.0, 1.0, 1.0, -1.0);
+    overlay_rect_[i]->setMaterial(overlay_material_name[i]);
+    overlay_rect_[i]->setBoundingBox(aabInf);
+    overlay_rect_[i]->setVisibilityFlags( visibility[i] );
+    composite_scene_->getRootSceneNode()->attachObject(overlay_rect_[i]);
+    createCompositeBackground(i);
+  }
+}
+
+void rvinciDisplay::createCompositeBackground(int i)
+{
+  static const unsigned int visibility[2] = {0x0F, 0xF0};
+  if (!composite_scene_ || composite_bg_rect_[i] || material_[i].isNull())
+    return;
+
+  composite_bg_rect_[i] = new Ogre::Rectangle2D(true);
+  composite_bg_rect_[i]->setCorners(-1.0, 1.0, 1.0, -1.0);
+  composite_bg_rect_[i]->setMaterial(material_[i]->getName());
+  composite_bg_rect_[i]->setRenderQueueGroup(Ogre::RENDER_QUEUE_BACKGROUND);
+  composite_bg_rect_[i]->setVisibilityFlags( visibility[i] );
+  Ogre::AxisAlignedBox aabInf;
+  aabInf.setInfinite();
+  composite_bg_rect_[i]->setBoundingBox(aabInf);
+  composite_scene_->getRootSceneNode()->attachObject(composite_bg_rect_[i]);
+}
+
+void rvinciDisplay::createOverlayTargets()
+{
+  static const char* const overlay_name[2] = {"StereoOverlayLeft", "StereoOverlayRight"};
+  static const unsigned int visibility[2] = {0x0F, 0xF0};
+  // The eye's own non-video bits, e.g. the latency caption
+  static const unsigned int overlay_visibility[2] = {0x0E, 0xE0};
+  createCompositeScene();
+
+  for (int i = 0; i < 2; ++i)
+  {
+    // The eye's place on the window now draws its video and the upscaled overlay
+    Ogre::Viewport* placed = viewport_[i];
+    Ogre::RenderTarget* window = placed->getTarget();
+    int z = placed->getZOrder();
+    float left = placed->getLeft(), top = placed->getTop();
+    float width = placed->getWidth(), height = placed->getHeight();
+    unsigned int pixels_w = std::max(1, placed->getActualWidth());
+    unsigned int pixels_h = std::max(1, placed->getActualHeight());
+#if OGRE_STEREO_ENABLE
+    Ogre::ColourBufferType buffer = placed->getDrawBuffer();
+#endif
+    window->removeViewport(z);
+    Ogre::Viewport* composite = window->addViewport(composite_camera_, z, left, top, width, height);
+#if OGRE_STEREO_ENABLE
+    composite->setDrawBuffer(buffer);
+#endif
+    composite->setBackgroundColour(bg_color_);
+    composite->setVisibilityMask( visibility[i] );
+
+    overlay_texture_[i] = Ogre::TextureManager::getSingleton().createManual(overlay_name[i],
+                            Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+                            Ogre::TEX_TYPE_2D,
+                            pixels_w, pixels_h,
+                            0,
+                            Ogre::PF_A8R8G8B8,
+                            Ogre::TU_RENDERTARGET);
+    Ogre::RenderTarget* target = overlay_texture_[i]->getBuffer()->getRenderTarget();
+    target->setAutoUpdated(false);
+    target->addListener(this);
+    // Everything but the video backgrounds, over a transparent clear
+    viewport_[i] = target->addViewport(camera_[i]);
+    viewport_[i]->setBackgroundColour(Ogre::ColourValue(0.0f, 0.0f, 0.0f, 0.0f));
+    viewport_[i]->setVisibilityMask( 0xFFFFFF00 | overlay_visibility[i] );
+    overlay_material_[i]->getTechnique(0)->getPass(0)->getTextureUnitState(0)->setTextureName(overlay_texture_[i]->getName());
+    stereo_targets_.insert(stereo_targets_.begin(), target);
+  }
+}
+
+void rvinciDisplay::applyResolutionScale()
+{
+  float scale = resolution_scale_;
+  for (int i = 0; i < 2; ++i)
+  {
+    if (overlay_texture_[i].isNull())
+      continue;
+    viewport_[i]->setDimensions(0.0f, 0.0f, scale, scale);
+    // Ogre scales texture coordinates about the centre; shift so [0,1] maps to [0,scale]
+    Ogre::TextureUnitState* unit = overlay_material_[i]->getTechnique(0)->getPass(0)->getTextureUnitState(0);
+    unit->setTextureScale(1.0f / scale, 1.0f / scale);
+    unit->setTextureScroll(0.5f * scale - 0.5f, 0.5f * scale - 0.5f);
+  }
+  layout_scale_ = scale;
+}
+
+void rvinciDisplay::createEyeTargets(unsigned int width, unsigned int height)
+{
+  static const char* const eye_name[2] = {"StereoEyeLeft", "StereoEyeRight"};
+
+  for (int i = 0; i < 2; ++i)
+  {
+    eye_texture_[i] = Ogre::TextureManager::getSingleton().createManual(eye_name[i],
+                        Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME,
+                        Ogre::TEX_TYPE_2D,
+                        width, height,
+                        0,
+                        Ogre::PF_R8G8B8,
+                        Ogre::TU_RENDERTARGET);
+    eye_texture_[i]->getBuffer()->getRenderTarget()->setAutoUpdated(false);
+  }
+}
+
+void rvinciDisplay::destroyEyeTargets()
+{
+  for (int i = 0; i < 2; ++i)
+  {
+    if (!eye_texture_[i].isNull())
+    {
+      eye_texture_[i]->getBuffer()->getRenderTarget()->removeAllViewports();
+      Ogre::TextureManager::getSingleton().remove(eye_texture_[i]->getHandle());
+      eye_texture_[i].setNull();
+    }
+    if (!overlay_texture_[i].isNull())
+    {
+      overlay_texture_[i]->getBuffer()->getRenderTarget()->removeAllViewports();
+      Ogre::TextureManager::getSingleton().remove(overlay_texture_[i]->getHandle());
+      overlay_texture_[i].setNull();
+    }
+  }
 }
 
 void rvinciDisplay::cameraReset()
@@ -542,6 +1710,12 @@ void rvinciDisplay::cameraReset()
 
 void rvinciDisplay::cameraUpdate()
 {
+  // Both windows render the same frame; the pose and projection are computed once per epoch.
+  if (camera_epoch_ == frame_epoch_)
+    return;
+  camera_epoch_ = frame_epoch_;
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::cameraUpdate");
+
   bool getTransform_ret;
   getTransform_ret = frame_manager_.getTransform(cam_header_, camera_pos_, camera_ori_);
   if (img_width_ < 1 || img_height_ < 1) {
@@ -559,18 +1733,23 @@ void rvinciDisplay::cameraUpdate()
 
   // ROS_INFO_STREAM("img width: "<<img_width_<<"img height: "<<img_height_);
 
-  Ogre::Matrix4 proj_matrix;
-  proj_matrix = Ogre::Matrix4::ZERO;
-  proj_matrix[0][0] = 2.0 * fx_ / img_width_;
-  proj_matrix[1][1] = 2.0 * fy_ / img_height_;
-  proj_matrix[0][2] = 2.0 * (0.5 - cx_ / img_width_);
-  proj_matrix[1][2] = 2.0 * (cy_ / img_height_ - 0.5);
-  proj_matrix[2][2] = -(100 + 0.01) / (100 - 0.01);
-  proj_matrix[2][3] = -2.0 * (100 * 0.01) / (100 - 0.01);
-  proj_matrix[3][2] = -1;
-
-  camera_[_LEFT]->setCustomProjectionMatrix(true, proj_matrix);
-  camera_[_RIGHT]->setCustomProjectionMatrix(true, proj_matrix);
+  // Only rebuilt when cameraInfoCallback received different intrinsics
+  if (projection_dirty_)
+  {
+    Ogre::Matrix4 proj_matrix;
+    proj_matrix = Ogre::Matrix4::ZERO;
+    proj_matrix[0][0] = 2.0 * fx_ / img_width_;
+    proj_matrix[1][1] = 2.0 * fy_ / img_height_;
+    proj_matrix[0][2] = 2.0 * (0.5 - cx_ / img_width_);
+    proj_matrix[1][2] = 2.0 * (cy_ / img_height_ - 0.5);
+    proj_matrix[2][2] = -(100 + 0.01) / (100 - 0.01);
+    proj_matrix[2][3] = -2.0 * (100 * 0.01) / (100 - 0.01);
+    proj_matrix[3][2] = -1;
+
+    camera_[_LEFT]->setCustomProjectionMatrix(true, proj_matrix);
+    camera_[_RIGHT]->setCustomProjectionMatrix(true, proj_matrix);
+    projection_dirty_ = false;
+  }
 
   camera_[_LEFT]->setPosition(camera_pos_);
   // camera_[_LEFT]->lookAt(0, 0, 0);
@@ -581,8 +1760,6 @@ void rvinciDisplay::cameraUpdate()
   camera_[_RIGHT]->setPosition(camera_pos_ + baseline_offset);
   // camera_[_RIGHT]->lookAt(0, 0, 0);
   camera_[_RIGHT]->setOrientation(camera_ori_);
-
-  frame_manager_.setFixedFrame("base_link");
 }
 
 void rvinciDisplay::preRenderTargetUpdate(const Ogre::RenderTargetEvent& evt)
@@ -592,10 +1769,17 @@ void rvinciDisplay::preRenderTargetUpdate(const Ogre::RenderTargetEvent& evt)
 
 void rvinciDisplay::postRenderTargetUpdate(const Ogre::RenderTargetEvent& evt)
 {
-  window_ = render_widget_->getRenderWindow();
-  window_->swapBuffers();
-  window_R_ = render_widget_R_->getRenderWindow();
-  window_R_->swapBuffers();
+  // Only the target that just finished is presented; paired mode swaps both in renderStereo().
+  if (prop_present_mode_->getOptionInt() == PRESENT_INDEPENDENT)
+  {
+    Ogre::RenderWindow* window = dynamic_cast<Ogre::RenderWindow*>(evt.source);
+    if (window)
+    {
+      ros::WallTime swap_start = ros::WallTime::now();
+      window->swapBuffers();
+      swap_time_ += (ros::WallTime::now() - swap_start).toSec();
+    }
+  }
 }
 
 void rvinciDisplay::onEnable()
@@ -605,12 +1789,18 @@ void rvinciDisplay::onEnable()
     cameraSetup();
   }
   render_widget_->setVisible(true);
-  render_widget_R_->setVisible(true);
+  render_widget_R_->setVisible(stereo_output_ == OUTPUT_DUAL_WINDOW);
   cameraReset();
+  updateRenderRate();
+  updateVSync();
+  render_timer_->start();
 }
 
 void rvinciDisplay::onDisable()
 {
+  render_timer_->stop();
+  // The time spent disabled is not a render interval.
+  last_render_time_ = ros::WallTime();
   render_widget_ ->setVisible(false);
   render_widget_R_ ->setVisible(false);
 }
@@ -707,6 +1897,7 @@ visualization_msgs::Marker rvinciDisplay::deleteAllMarkers() {
 
 void rvinciDisplay::publishMeasurementMarkers()
 {
+  RVINCI_PROFILE_SCOPE("rvinciDisplay::publishMeasurementMarkers");
   visualization_msgs::MarkerArray marker_arr;
   geometry_msgs::Pose text_pose, distance_pose;
   text_pose.position.x = text_pose.position.y = text_pose.position.z = 0.0;
@@ -937,6 +2128,9 @@ void rvinciDisplay::cameraCallback(const sensor_msgs::Joy::ConstPtr& msg)
 void rvinciDisplay::MTMCallback(const geometry_msgs::PoseStamped::ConstPtr& msg, int i)
 {
 
+  mtm_stamp_ = ros::Time::now();
+  // Lets whoever sent the sample match it to the cursor update that shows it
+  mtm_sample_stamp_ = msg->header.stamp.isZero() ? mtm_stamp_ : msg->header.stamp;
   rvmsg_.gripper[i].pose = msg->pose;
   rvmsg_.gripper[i].pose.position.x *= -1;
   rvmsg_.gripper[i].pose.position.y *= -1;
@@ -1040,18 +2234,25 @@ void rvinciDisplay::coagCallback(const sensor_msgs::Joy::ConstPtr& msg)
     cursor_[_RIGHT].position.x += 10;
     grab[_LEFT] = 0;
     grab[_RIGHT] = 0;
-    publishCursorUpdate(grab);
+    publishCursorUpdate(grab, ros::Time::now());
   }
+  scene_dirty_ = true;
 }
 
 void rvinciDisplay::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg)
 {
+  cam_header_ = msg->header;
+
+  if (msg->P[0] != fx_ || msg->P[5] != fy_ || msg->P[2] != cx_ || msg->P[6] != cy_ ||
+      msg->width != img_width_ || msg->height != img_height_)
+  {
+    projection_dirty_ = true;
+  }
   fx_ = msg->P[0];
   tx_ = msg->P[3];
   cx_ = msg->P[2];
   cy_ = msg->P[6];
   fy_ = msg->P[5];
-  cam_header_ = msg->header;
   img_width_ = msg->width;
   img_height_ = msg->height;
 }
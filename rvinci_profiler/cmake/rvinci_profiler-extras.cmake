@@ -0,0 +1,6 @@
+# Scoped timers cost a clock read per scope; they are compiled out unless enabled,
+# e.g. catkin_make -DRVINCI_PROFILING=ON
+option(RVINCI_PROFILING "Record RVINCI_PROFILE_SCOPE timings for Chrome trace dumps" OFF)
+if (RVINCI_PROFILING)
+  add_definitions(-DRVINCI_PROFILING)
+endif (RVINCI_PROFILING)
@@ -0,0 +1,243 @@
+#ifndef RVINCI_PROFILER_PROFILER_H
+#define RVINCI_PROFILER_PROFILER_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include <ros/ros.h>
+#include <ros/file_log.h>
+#include <std_srvs/Trigger.h>
+
+//! Times the enclosing block under name, a string literal.
+/*! Expands to nothing unless the package was built with RVINCI_PROFILING.*/
+#ifdef RVINCI_PROFILING
+#define RVINCI_PROFILE_CONCAT_(a, b) a##b
+#define RVINCI_PROFILE_CONCAT(a, b) RVINCI_PROFILE_CONCAT_(a, b)
+#define RVINCI_PROFILE_SCOPE(name) \
+  ::rvinci_profiler::Scope RVINCI_PROFILE_CONCAT(rvinci_profile_scope_, __LINE__)(name)
+#else
+#define RVINCI_PROFILE_SCOPE(name) ((void)0)
+#endif
+
+namespace rvinci_profiler
+{
+//! One timed scope, in nanoseconds of the monotonic clock.
+/*! The clock is shared by all processes on the machine, so traces of
+ * several nodes line up on one timeline.
+ */
+struct Event
+{
+  const char* name;
+  int64_t begin;
+  int64_t end;
+};
+
+inline int64_t now()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//! Ring of the latest events of one thread.
+/*! Only the owning thread writes, without locks. Each slot carries a
+ * sequence number in the manner of a seqlock: odd while the writer fills
+ * it, even once the event is complete. A reader racing the writer drops
+ * every event whose slot changed under it, and nothing else.
+ */
+class ThreadBuffer
+{
+public:
+  static const size_t CAPACITY = 1 << 14;
+
+  explicit ThreadBuffer(int tid) : tid_(tid), head_(0), slots_(new Slot[CAPACITY]) {}
+
+  void push(const char* name, int64_t begin, int64_t end)
+  {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    Slot& slot = slots_[head & (CAPACITY - 1)];
+    slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.name.store(name, std::memory_order_relaxed);
+    slot.begin.store(begin, std::memory_order_relaxed);
+    slot.end.store(end, std::memory_order_relaxed);
+    slot.seq.store(2 * head + 2, std::memory_order_release);
+    head_.store(head + 1, std::memory_order_release);
+  }
+
+  //!Appends the events still held in the ring, oldest first.
+  void copy(std::vector<Event>& out) const
+  {
+    uint64_t head = head_.load(std::memory_order_acquire);
+    uint64_t first = head > CAPACITY ? head - CAPACITY : 0;
+    for (uint64_t k = first; k < head; ++k)
+    {
+      const Slot& slot = slots_[k & (CAPACITY - 1)];
+      // Event k is intact only if its slot held it, complete, before and after the read.
+      uint64_t seq = slot.seq.load(std::memory_order_acquire);
+      if (seq != 2 * k + 2)
+        continue;
+      Event event;
+      event.name = slot.name.load(std::memory_order_relaxed);
+      event.begin = slot.begin.load(std::memory_order_relaxed);
+      event.end = slot.end.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (slot.seq.load(std::memory_order_relaxed) != seq)
+        continue;
+      out.push_back(event);
+    }
+  }
+
+  int tid() const { return tid_; }
+
+private:
+  struct Slot
+  {
+    Slot() : seq(0), name(0), begin(0), end(0) {}
+    std::atomic<uint64_t> seq;
+    std::atomic<const char*> name;
+    std::atomic<int64_t> begin;
+    std::atomic<int64_t> end;
+  };
+
+  int tid_;
+  std::atomic<uint64_t> head_;
+  std::unique_ptr<Slot[]> slots_;
+};
+
+//! Every thread buffer of the process; kept after the thread exits.
+class Registry
+{
+public:
+  static Registry& instance()
+  {
+    static Registry registry;
+    return registry;
+  }
+
+  //!Called once per thread, on its first scope.
+  std::shared_ptr<ThreadBuffer> create()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.push_back(std::make_shared<ThreadBuffer>((int)buffers_.size() + 1));
+    return buffers_.back();
+  }
+
+  std::vector<std::shared_ptr<ThreadBuffer> > buffers()
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return buffers_;
+  }
+
+private:
+  std::mutex mutex_;
+  std::vector<std::shared_ptr<ThreadBuffer> > buffers_;
+};
+
+inline ThreadBuffer& threadBuffer()
+{
+  thread_local std::shared_ptr<ThreadBuffer> buffer = Registry::instance().create();
+  return *buffer;
+}
+
+class Scope
+{
+public:
+  explicit Scope(const char* name) : name_(name), begin_(now()) {}
+  ~Scope() { threadBuffer().push(name_, begin_, now()); }
+
+private:
+  Scope(const Scope&);
+  Scope& operator=(const Scope&);
+
+  const char* name_;
+  int64_t begin_;
+};
+
+//! Writes the events of all threads as Chrome trace-event JSON.
+/*! Load the file in chrome://tracing or Perfetto; files of several
+ * processes can be merged by concatenating their traceEvents arrays.
+ */
+inline bool writeChromeTrace(const std::string& path, const std::string& process_name, std::string& error)
+{
+  std::ofstream out(path.c_str(), std::ios::out | std::ios::trunc);
+  if (!out.is_open())
+  {
+    error = "Cannot open '" + path + "'";
+    return false;
+  }
+  int pid = (int)getpid();
+  out << "{\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid
+      << ",\"args\":{\"name\":\"" << process_name << "\"}}";
+
+  std::vector<std::shared_ptr<ThreadBuffer> > buffers = Registry::instance().buffers();
+  std::vector<Event> events;
+  out.precision(3);
+  out << std::fixed;
+  for (size_t b = 0; b < buffers.size(); ++b)
+  {
+    events.clear();
+    buffers[b]->copy(events);
+    for (size_t e = 0; e < events.size(); ++e)
+    {
+      // Complete events, timestamps in microseconds
+      out << ",\n{\"name\":\"" << events[e].name << "\",\"ph\":\"X\",\"pid\":" << pid
+          << ",\"tid\":" << buffers[b]->tid()
+          << ",\"ts\":" << events[e].begin / 1000.0
+          << ",\"dur\":" << (events[e].end - events[e].begin) / 1000.0 << "}";
+    }
+  }
+  out << "\n]}\n";
+  if (!out)
+  {
+    error = "Failed writing '" + path + "'";
+    return false;
+  }
+  return true;
+}
+
+//! Service dumping the trace of this process to the ROS log directory.
+/*! The response message holds the path of the file written.*/
+class TraceService
+{
+public:
+  TraceService() {}
+
+  void advertise(ros::NodeHandle& nh, const std::string& process_name)
+  {
+    process_name_ = process_name;
+    server_ = nh.advertiseService("dump_trace", &TraceService::dump, this);
+  }
+
+  bool dump(std_srvs::Trigger::Request&, std_srvs::Trigger::Response& res)
+  {
+#ifdef RVINCI_PROFILING
+    std::string path = ros::file_log::getLogDirectory() + "/" + process_name_ + "-" +
+                       std::to_string(getpid()) + "-" + std::to_string(ros::WallTime::now().sec) + ".trace.json";
+    std::string error;
+    res.success = writeChromeTrace(path, process_name_, error);
+    res.message = res.success ? path : error;
+#else
+    res.success = false;
+    res.message = "Built without RVINCI_PROFILING";
+#endif
+    return true;
+  }
+
+private:
+  std::string process_name_;
+  ros::ServiceServer server_;
+};
+
+} // namespace rvinci_profiler
+
+#endif